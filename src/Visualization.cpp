@@ -1,6 +1,14 @@
 #include "Visualization.h"
 #include "tree.h"
 #include "hashTable.h"
+#include "dataset.h"
+#include "geography.h"
+#include "trace.h"
+#include "memoryStats.h"
+#include "formula.h"
+#include "queryCache.h"
+#include "queryExecutor.h"
+#include "benchmark.h"
 
 #include <SFML/Graphics.hpp>
 #include <unordered_map>
@@ -14,6 +22,10 @@
 #include <array>
 #include <chrono>
 #include <cmath>
+#include <cstring>
+#include <atomic>
+#include <filesystem>
+#include <thread>
 
 using namespace std;
 
@@ -51,7 +63,7 @@ namespace Visualization {
             if (unicode < 32 || unicode > 126) return;
             char ch = static_cast<char>(unicode);
             if (mode=="digits" && !isdigit((unsigned char)ch)) return;
-            if (mode=="letters" && !(isalpha((unsigned char)ch) || ch==' ' || ch=='-' || ch==',')) return;
+            if (mode=="letters" && !(isalpha((unsigned char)ch) || ch==' ' || ch=='-' || ch==',' || ch=='.' || ch=='\'')) return;
             if (mode=="lettersOnly" && !isalpha((unsigned char)ch)) return;
             if (forceUpper) ch = (char)toupper((unsigned char)ch);
             if (value.size() >= maxLen) return;
@@ -182,6 +194,8 @@ namespace Visualization {
             const unordered_map<unsigned,sf::Color>& stateColorLUT,
             sf::Image& out
     ){
+        TRACE_SCOPE("repaintFromLabels");
+        memoryStats::Scope mem(memoryStats::Subsystem::Rasters);
         out.create(W, H, sf::Color(0,0,0,0));
         for (unsigned y=0; y<H; ++y){
             for (unsigned x=0; x<W; ++x){
@@ -195,6 +209,28 @@ namespace Visualization {
         }
     }
 
+    // Repaint only the pixels of the given state keys, borders stay as they are.
+    static void repaintStates(
+            const vector<unsigned>& labels,
+            const vector<unsigned char>& border,
+            unsigned W, unsigned H,
+            const unordered_map<unsigned,sf::Color>& stateColorLUT,
+            const vector<unsigned>& keys,
+            sf::Image& out
+    ){
+        TRACE_SCOPE("repaintStates");
+        for (unsigned y=0; y<H; ++y){
+            for (unsigned x=0; x<W; ++x){
+                unsigned i = y*W + x;
+                unsigned key = labels[i];
+                if (key==0 || border[i]) continue;
+                if (find(keys.begin(), keys.end(), key) == keys.end()) continue;
+                auto it = stateColorLUT.find(key);
+                out.setPixel(x,y, (it!=stateColorLUT.end()) ? it->second : sf::Color(0,0,0,0));
+            }
+        }
+    }
+
     // Color Palette
     static array<sf::Color,5> buildShades(sf::Color base) {
         float factors[5] = {0.60f, 0.80f, 1.00f, 1.15f, 1.30f};
@@ -224,47 +260,158 @@ namespace Visualization {
         return string(buf);
     }
 
-    // Attribute toggle function
-    static const vector<string> kAttributes = {
-            "Civilian_labor_force",
-            "Employed",
-            "Med_HH_Income_Percent_of_State_Total",
-            "Median_Household_Income",
-            "Metro",
-            "Rural_Urban_Continuum_Code",
-            "Unemployed",
-            "Unemployment_Rate",
-            "Urban_Influence_Code"
-    };
-
-    // State ordering
-    static const vector<string> kStateOrder = {
-            "AL","AK","AZ","AR","CA","CO","CT","DE","FL","GA",
-            "HI","ID","IL","IN","IA","KS","KY","LA","ME","MD",
-            "MA","MI","MN","MS","MO","MT","NE","NV","NH","NJ",
-            "NM","NY","NC","ND","OH","OK","OR","PA","RI","SC",
-            "SD","TN","TX","UT","VT","VA","WA","WV","WI","WY"
-    };
+    // Attribute toggle: the schema's attributes in declared order, then any other raw attribute
+    // the input files had. Names are already canonical, so each is looked up under one spelling.
+    static vector<string> rawAttributes(const Dataset& d){
+        vector<string> out;
+        for (const auto& a : d.schema->attributes) if (d.series.has(a.name)) out.push_back(a.name);
+        const vector<string>& derived = d.series.derivedAttributes();
+        for (const auto& a : d.series.attributes()){
+            if (find(derived.begin(), derived.end(), a) != derived.end()) continue;
+            if (find(out.begin(), out.end(), a) == out.end()) out.push_back(a);
+        }
+        return out;
+    }
 
-    // MAIN STUFF
-    int visualizer(Tree tree, hashTable hashData, vector<float> stateData){
+    // Map preparation
+    bool loadMapRaster(MapRaster& map){
+        TRACE_SCOPE("loadMapRaster");
+        memoryStats::Scope mem(memoryStats::Subsystem::Rasters);
         string pngPath = findFile("usa_color_ids.png"); if (pngPath.empty()) pngPath = findFile("data/usa_color_ids.png");
         string csvPath = findFile("ids.csv");          if (csvPath.empty())  csvPath = findFile("data/ids.csv");
-        if (pngPath.empty() || csvPath.empty()){ cerr<<"Missing usa_color_ids.png or ids.csv\n"; return 1; }
+        if (pngPath.empty() || csvPath.empty()){ cerr<<"Missing usa_color_ids.png or ids.csv\n"; return false; }
+
+        if (!map.idImage.loadFromFile(pngPath)){ cerr<<"Failed to load "<<pngPath<<"\n"; return false; }
+        map.W = map.idImage.getSize().x; map.H = map.idImage.getSize().y;
+
+        map.colorToAbbr.clear(); map.abbrToColor.clear();
+        if (!loadIdsCSV(csvPath.c_str(), map.colorToAbbr, map.abbrToColor)){ cerr<<"Cannot load ids.csv\n"; return false; }
+
+        map.keys.clear(); map.keys.reserve(map.colorToAbbr.size());
+        for (auto& kv : map.colorToAbbr) map.keys.push_back(kv.first);
+        return true;
+    }
+    void classifyMapRaster(MapRaster& map){
+        TRACE_SCOPE("classifyLabels");
+        memoryStats::Scope mem(memoryStats::Subsystem::Rasters);
+        map.labels = classifyLabels(map.idImage, map.colorToAbbr, map.keys, 16);
+    }
+    void buildMapBorders(MapRaster& map){
+        TRACE_SCOPE("buildBorderMask");
+        memoryStats::Scope mem(memoryStats::Subsystem::Rasters);
+        map.border = buildBorderMaskFromLabels(map.labels, map.W, map.H);
+    }
+
+    int exportMaps(const Dataset& data, const MapRaster& map, const string& outDir, int threads){
+        TRACE_SCOPE("exportMaps");
+        error_code ec;
+        filesystem::create_directories(outDir, ec);
+        if (ec){ cerr << "Cannot create " << outDir << ": " << ec.message() << "\n"; return 1; }
+
+        // Every pixel resolved to a state id once, so a map is one palette lookup per pixel
+        const unsigned char kOutside = 0xff, kBorder = 0xfe;
+        vector<unsigned char> pixelState(size_t(map.W) * map.H, kOutside);
+        unordered_map<unsigned,int> keyToState;
+        for (auto& kv : map.colorToAbbr){
+            int s = geography::stateIdFromAbbrev(kv.second);
+            if (s >= 0) keyToState[kv.first] = s;
+        }
+        for (size_t i=0; i<pixelState.size(); ++i){
+            if (map.labels[i]==0) continue;
+            if (map.border[i]) { pixelState[i] = kBorder; continue; }
+            auto it = keyToState.find(map.labels[i]);
+            if (it != keyToState.end()) pixelState[i] = (unsigned char)it->second;
+        }
+
+        // Every year of every attribute in the series store, then of every saved formula
+        vector<pair<string, formula>> formulas;
+        {
+            vector<pair<string, string>> saved;
+            loadFormulas(kFormulaPath, saved);
+            for (auto& nt : saved){
+                formula f; string err;
+                if (f.compile(nt.second, data.series, err)) formulas.push_back({nt.first, std::move(f)});
+                else cerr << "Formula " << nt.first << ": " << err << "\n";
+            }
+        }
+        struct Job { string name; int year; const formula* f; float lo = NAN, hi = NAN; bool written = false; };
+        vector<Job> jobs;
+        for (const auto& attr : data.series.attributes())
+            for (int y = data.series.firstYear(); y <= data.series.lastYear(); ++y) jobs.push_back({attr, y, nullptr});
+        for (const auto& nf : formulas)
+            for (int y = data.series.firstYear(); y <= data.series.lastYear(); ++y) jobs.push_back({nf.first, y, &nf.second});
 
-        sf::Image idImage;
-        if (!idImage.loadFromFile(pngPath)){ cerr<<"Failed to load "<<pngPath<<"\n"; return 1; }
-        unsigned imgW = idImage.getSize().x, imgH = idImage.getSize().y;
+        auto shade = buildShades(sf::Color(220,60,60));
+        atomic<size_t> next{0}, failed{0};
+        auto worker = [&]{
+            vector<float> values(geography::kStateCount), counties;
+            vector<sf::Uint8> pixels(size_t(map.W) * map.H * 4);
+            sf::Image image;
+            for (size_t j = next++; j < jobs.size(); j = next++){
+                Job& job = jobs[j];
+                if (job.f){
+                    if (job.f->evaluate(data.series, job.year, counties)) data.series.stateMeansOf(counties, values.data());
+                    else fill(values.begin(), values.end(), NAN);
+                } else {
+                    data.series.stateMeans(job.name, job.year, values.data());
+                }
+                // Same legend range and shading as the window; years without data are skipped
+                float lo = 1e9f, hi = -1e9f;
+                for (float v : values) if (!std::isnan(v)) { lo = min(lo, v); hi = max(hi, v); }
+                if (lo > hi) continue;
+                if (!(lo < hi)) { lo = 0.f; hi = 10.f; }
+                job.lo = lo; job.hi = hi;
 
-        unordered_map<unsigned,string> colorToAbbr;
-        unordered_map<string,unsigned> abbrToColor;
-        if (!loadIdsCSV(csvPath.c_str(), colorToAbbr, abbrToColor)){ cerr<<"Cannot load ids.csv\n"; return 1; }
+                array<array<sf::Uint8,4>,256> palette{};
+                for (int s=0; s<geography::kStateCount; ++s){
+                    if (std::isnan(values[s])) continue;
+                    sf::Color c = shade[4 - bucketIndex(values[s], lo, hi, 5)];
+                    palette[s] = {c.r, c.g, c.b, 255};
+                }
+                palette[kBorder] = {0, 0, 0, 255};
+                for (size_t i=0; i<pixelState.size(); ++i) memcpy(&pixels[i * 4], palette[pixelState[i]].data(), 4);
+                image.create(map.W, map.H, pixels.data());
+                job.written = image.saveToFile(outDir + "/" + job.name + "_" + to_string(job.year) + ".png");
+                if (!job.written) failed++;
+            }
+        };
+        if (threads < 1) threads = max(1u, thread::hardware_concurrency());
+        auto tA = std::chrono::steady_clock::now();
+        vector<thread> pool;
+        for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (auto& th : pool) th.join();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - tA).count();
 
-        vector<unsigned> keys; keys.reserve(colorToAbbr.size());
-        for (auto& kv : colorToAbbr) keys.push_back(kv.first);
+        // Legend of every written map, for captions in reports
+        ofstream index(outDir + "/index.csv");
+        index << "file,series,year,low,high\n";
+        size_t written = 0;
+        for (const auto& job : jobs){
+            if (!job.written) continue;
+            written++;
+            index << job.name << "_" << job.year << ".png," << job.name << (job.f ? " (formula)" : "") << ","
+                  << job.year << "," << job.lo << "," << job.hi << "\n";
+        }
+        char buf[160];
+        snprintf(buf, sizeof(buf), "Wrote %zu maps to %s in %.2f s (%.1f maps/s, %d threads), %zu without data",
+                 written, outDir.c_str(), secs, written / max(secs, 1e-9), threads, jobs.size() - written - failed);
+        cout << buf << endl;
+        if (failed) cerr << failed << " maps could not be written" << endl;
+        return failed ? 1 : 0;
+    }
 
-        vector<unsigned> labelImage = classifyLabels(idImage, colorToAbbr, keys, 16);
-        vector<unsigned char> borderMask = buildBorderMaskFromLabels(labelImage, imgW, imgH);
+    // MAIN STUFF
+    int visualizer(DatasetStore& store){
+        MapRaster map;
+        if (!loadMapRaster(map)) return 1;
+        classifyMapRaster(map);
+        buildMapBorders(map);
+        unsigned imgW = map.W, imgH = map.H;
+        const unordered_map<unsigned,string>& colorToAbbr = map.colorToAbbr;
+        const unordered_map<string,unsigned>& abbrToColor = map.abbrToColor;
+        const vector<unsigned>& labelImage = map.labels;
+        const vector<unsigned char>& borderMask = map.border;
 
         unordered_map<unsigned,sf::Color> stateColorLUT;
         sf::Image coloredImage;
@@ -297,6 +444,17 @@ namespace Visualization {
         header.setString("US Map - NEED Index");
         header.setPosition(PAD, (HEADER_H - 22.f)/2.f - 1.f);
 
+        // Map attribute (click to cycle): NEED index, or the state mean of any attribute
+        Button mapBtn; mapBtn.id = "map";
+        mapBtn.box.setSize({280.f, 34.f});
+        mapBtn.box.setPosition(WIN_W - SIDEBAR_W - 2*PAD - 280.f, (HEADER_H - 34.f)/2.f);
+        mapBtn.box.setFillColor(sf::Color(245,245,248));
+        mapBtn.box.setOutlineThickness(1.f);
+        mapBtn.box.setOutlineColor(sf::Color(80,90,110));
+        mapBtn.label.setFont(uiFont); mapBtn.label.setCharacterSize(12); mapBtn.label.setFillColor(sf::Color(30,40,55));
+        mapBtn.label.setString("Map: NEED index");
+        mapBtn.label.setPosition(mapBtn.box.getPosition().x + 10.f, mapBtn.box.getPosition().y + 9.f);
+
         // Sidebar
         const float sideX = WIN_W - SIDEBAR_W - PAD;
         const float sideY = HEADER_H;
@@ -346,7 +504,48 @@ namespace Visualization {
         countyInput.text.setPosition(countyInput.box.getPosition().x + 10.f, countyInput.box.getPosition().y + 6.f);
         countyInput.placeholder.setPosition(countyInput.text.getPosition());
 
-        // Attribute (click to cycle)
+        // County type-ahead, drawn over the controls below the county box while it has focus
+        const int kSuggest = 5;
+        const float kSuggestRow = 22.f;
+        sf::RectangleShape suggestBg; suggestBg.setFillColor(sf::Color(245,245,248)); suggestBg.setOutlineThickness(1.f); suggestBg.setOutlineColor(sf::Color(120,160,255));
+        suggestBg.setPosition(countyInput.box.getPosition().x, countyInput.box.getPosition().y + 34.f);
+        array<sf::Text, kSuggest> suggestText;
+        for (int i=0;i<kSuggest;i++){
+            suggestText[i].setFont(uiFont); suggestText[i].setCharacterSize(16); suggestText[i].setFillColor(sf::Color(30,40,55));
+            suggestText[i].setPosition(suggestBg.getPosition().x + 10.f, suggestBg.getPosition().y + 3.f + i * kSuggestRow);
+        }
+        int suggestIds[kSuggest];
+        size_t suggestCount = 0;
+        auto refreshSuggestions = [&](){
+            suggestCount = 0;
+            if (countyInput.value.empty()) return;
+            auto data = store.snapshot();
+            suggestCount = data->counties.suggest(geography::stateIdFromAbbrev(stateInput.value), countyInput.value, suggestIds, kSuggest);
+            for (size_t i=0;i<suggestCount;i++) suggestText[i].setString(data->counties.counties()[suggestIds[i]].name);
+            suggestBg.setSize({SIDEBAR_W - 24.f, 6.f + suggestCount * kSuggestRow});
+        };
+        auto acceptSuggestion = [&](size_t i){
+            countyInput.value = string(suggestText[i].getString());
+            countyInput.text.setString(countyInput.value);
+            suggestCount = 0;
+        };
+
+        // Attribute (click to cycle): the raw attributes, then the derived series of the store
+        vector<string> attrList = rawAttributes(*store.snapshot());
+        const size_t rawCount = attrList.size();
+        for (const auto& d : store.snapshot()->series.derivedAttributes()) attrList.push_back(d);
+
+        // Saved formulas, compiled once; the map button cycles through them after the attributes
+        vector<pair<string, formula>> formulas;
+        {
+            vector<pair<string, string>> saved;
+            loadFormulas(kFormulaPath, saved);
+            for (auto& nt : saved){
+                formula f; string err;
+                if (f.compile(nt.second, store.snapshot()->series, err)) formulas.push_back({nt.first, std::move(f)});
+                else cerr << "Formula " << nt.first << ": " << err << "\n";
+            }
+        }
         Button attrBtn; attrBtn.id = "attr";
         attrBtn.box.setSize({SIDEBAR_W - 24.f, 34.f});
         attrBtn.box.setPosition(sideX + 12.f, nextY(34.f));
@@ -355,11 +554,13 @@ namespace Visualization {
         attrBtn.box.setOutlineColor(sf::Color(80,90,110));
         attrBtn.label.setFont(uiFont); attrBtn.label.setCharacterSize(12); attrBtn.label.setFillColor(sf::Color(30,40,55));
         size_t attrIdx=0;
-        attrBtn.label.setString(string("Attribute: ") + kAttributes[attrIdx]);
+        attrBtn.label.setString(string("Attribute: ") + attrList[attrIdx]);
         attrBtn.label.setPosition(attrBtn.box.getPosition().x + 10.f, attrBtn.box.getPosition().y + 6.f);
 
+        // Search and, beside it, the lookup benchmark of the same query
+        const float searchW = (SIDEBAR_W - 24.f) * 0.6f;
         Button searchBtn; searchBtn.id = "search";
-        searchBtn.box.setSize({SIDEBAR_W - 24.f, 38.f});
+        searchBtn.box.setSize({searchW - 6.f, 38.f});
         searchBtn.box.setPosition(sideX + 12.f, nextY(38.f));
         searchBtn.box.setFillColor(sf::Color(245,245,248));
         searchBtn.box.setOutlineThickness(1.f);
@@ -368,6 +569,16 @@ namespace Visualization {
         searchBtn.label.setString("Search");
         searchBtn.label.setPosition(searchBtn.box.getPosition().x + 10.f, searchBtn.box.getPosition().y + 7.f);
 
+        Button benchBtn; benchBtn.id = "bench";
+        benchBtn.box.setSize({SIDEBAR_W - 24.f - searchW, 38.f});
+        benchBtn.box.setPosition(sideX + 12.f + searchW, searchBtn.box.getPosition().y);
+        benchBtn.box.setFillColor(sf::Color(245,245,248));
+        benchBtn.box.setOutlineThickness(1.f);
+        benchBtn.box.setOutlineColor(sf::Color(80,90,110));
+        benchBtn.label.setFont(uiFont); benchBtn.label.setCharacterSize(16); benchBtn.label.setFillColor(sf::Color(30,40,55));
+        benchBtn.label.setString("Benchmark");
+        benchBtn.label.setPosition(benchBtn.box.getPosition().x + 10.f, benchBtn.box.getPosition().y + 9.f);
+
         // Output
         sf::RectangleShape outputPanel; outputPanel.setFillColor(sf::Color(24,24,30)); outputPanel.setOutlineThickness(1.f); outputPanel.setOutlineColor(sf::Color(90,90,110));
         outputPanel.setPosition(sideX + 12.f, nextY(56.f));
@@ -376,10 +587,21 @@ namespace Visualization {
         outputText.setString("");
         outputText.setPosition(outputPanel.getPosition().x + 10.f, outputPanel.getPosition().y + 10.f);
 
+        // Sparkline of the searched county (bright) against the state mean (grey), right half of the output panel.
+        // The vertex arrays keep their capacity between searches, so redrawing them does not allocate.
+        const size_t kSparkYears = 64;
+        const sf::FloatRect sparkArea{outputPanel.getPosition().x + (SIDEBAR_W - 24.f) * 0.45f, outputPanel.getPosition().y + 8.f,
+                                      (SIDEBAR_W - 24.f) * 0.55f - 10.f, 40.f};
+        sf::VertexArray sparkCounty(sf::Lines), sparkState(sf::Lines);
+        sparkCounty.resize(2 * kSparkYears); sparkCounty.clear();
+        sparkState.resize(2 * kSparkYears);  sparkState.clear();
+        sf::CircleShape sparkDot(3.f); sparkDot.setOrigin(3.f, 3.f); sparkDot.setFillColor(sf::Color(255,210,80));
+        bool showSparkDot = false;
+
         // Timings
         sf::RectangleShape cxPanel; cxPanel.setFillColor(sf::Color(24,24,30)); cxPanel.setOutlineThickness(1.f); cxPanel.setOutlineColor(sf::Color(90,90,110));
-        cxPanel.setPosition(sideX + 12.f, nextY(70.f));
-        cxPanel.setSize({SIDEBAR_W - 24.f, 70.f});
+        cxPanel.setPosition(sideX + 12.f, nextY(88.f));
+        cxPanel.setSize({SIDEBAR_W - 24.f, 88.f});
         sf::Text cxText; cxText.setFont(uiFont); cxText.setCharacterSize(14); cxText.setFillColor(sf::Color(230,230,235));
         cxText.setString("Hash:   time - ms\nN-arytree: time - ms)");
         cxText.setPosition(cxPanel.getPosition().x + 10.f, cxPanel.getPosition().y + 6.f);
@@ -399,6 +621,15 @@ namespace Visualization {
         array<sf::Text,5> swatchText{};
         auto shade = buildShades(sf::Color(220,60,60));
         float rowY = legendPanel.getPosition().y + 34.f;
+        // Memory debug panel (F3), drawn over the key
+        bool showMemPanel = false;
+        sf::Text memText; memText.setFont(uiFont); memText.setCharacterSize(12); memText.setFillColor(sf::Color(230,230,235));
+        memText.setPosition(legendPanel.getPosition().x + 10.f, legendPanel.getPosition().y + 6.f);
+        // Ranking panel (F4, or after a search), drawn over the key
+        bool showRankPanel = false;
+        sf::Text rankText; rankText.setFont(uiFont); rankText.setCharacterSize(12); rankText.setFillColor(sf::Color(230,230,235));
+        rankText.setPosition(legendPanel.getPosition().x + 10.f, legendPanel.getPosition().y + 6.f);
+
         for (int i=0;i<5;i++){
             swatch[i].setSize({ 32.f, 18.f });
             swatch[i].setPosition(legendPanel.getPosition().x + 10.f, rowY + i*(18.f + 8.f));
@@ -410,52 +641,124 @@ namespace Visualization {
             swatchText[i].setPosition(swatch[i].getPosition().x + 32.f + 8.f, swatch[i].getPosition().y - 1.f);
         }
 
-        // Name map for hover
-        unordered_map<string,string> abbrName = {
-                {"AL","Alabama"},{"AK","Alaska"},{"AZ","Arizona"},{"AR","Arkansas"},{"CA","California"},
-                {"CO","Colorado"},{"CT","Connecticut"},{"DE","Delaware"},{"FL","Florida"},{"GA","Georgia"},
-                {"HI","Hawaii"},{"ID","Idaho"},{"IL","Illinois"},{"IN","Indiana"},{"IA","Iowa"},
-                {"KS","Kansas"},{"KY","Kentucky"},{"LA","Louisiana"},{"ME","Maine"},{"MD","Maryland"},
-                {"MA","Massachusetts"},{"MI","Michigan"},{"MN","Minnesota"},{"MS","Mississippi"},{"MO","Missouri"},
-                {"MT","Montana"},{"NE","Nebraska"},{"NV","Nevada"},{"NH","New Hampshire"},{"NJ","New Jersey"},
-                {"NM","New Mexico"},{"NY","New York"},{"NC","North Carolina"},{"ND","North Dakota"},{"OH","Ohio"},
-                {"OK","Oklahoma"},{"OR","Oregon"},{"PA","Pennsylvania"},{"RI","Rhode Island"},{"SC","South Carolina"},
-                {"SD","South Dakota"},{"TN","Tennessee"},{"TX","Texas"},{"UT","Utah"},{"VT","Vermont"},
-                {"VA","Virginia"},{"WA","Washington"},{"WV","West Virginia"},{"WI","Wisconsin"},{"WY","Wyoming"}
-        };
+        // Repeated lookups are answered from these; both empty themselves when the dataset version changes
+        queryCache hashCache(1024), treeCache(1024);
+        // cxText while a benchmark runs
+        const string kBenchRunning = "Benchmarking...";
+
+        // Searches and map queries run on workers and post their results back to this thread
+        // (drained once per frame). Declared after everything the jobs and their results use, so
+        // it joins its workers before any of it is destroyed: locals declared below must not be
+        // referenced from a job, only from the posted results, which run on this thread.
+        queryExecutor executor;
+        enum { kSearchChannel, kMapChannel };
 
         // Pair each state  with a value from stateData.
+        // Called again for every new dataset version; only states whose value
+        // changed are recolored unless one leaves the legend range.
         unordered_map<string,float> perState;
-        {
-            size_t n = min(kStateOrder.size(), stateData.size());
+        float legendLo = 0.f, legendHi = 10.f;
+        bool painted = false;
+        auto colorStates = [&](const vector<float>& stateData){
+            unordered_map<string,float> next;
+            size_t n = min<size_t>(geography::kStateCount, stateData.size());
             for (size_t i=0;i<n;i++){
-                perState[kStateOrder[i]] = stateData[i];
+                if (std::isnan(stateData[i])) continue;   // no data for this state
+                next[string(geography::kStates[i].abbrev)] = stateData[i];
+            }
+            vector<string> changed;
+            bool full = !painted;
+            for (auto& kv: next){
+                auto it = perState.find(kv.first);
+                if (it != perState.end() && it->second == kv.second) continue;
+                changed.push_back(kv.first);
+                if (kv.second < legendLo || kv.second > legendHi) full = true;
             }
-            // compute min/max for legend
-            float lo=1e9f, hi=-1e9f;
-            for (auto& kv: perState){ lo=min(lo, kv.second); hi=max(hi, kv.second); }
-            if (!(lo<hi)) { lo=0.f; hi=10.f; }
-            for (int i=0;i<5;i++){
-                float a = lo + (hi-lo)* (i/5.f);
-                float b = lo + (hi-lo)* ((i+1)/5.f);
-                swatchText[i].setString(fmtNum(a) + " - " + fmtNum(b));
+            perState.swap(next);
+            if (!full && changed.empty()) return;
+
+            if (full){
+                // compute min/max for legend
+                float lo=1e9f, hi=-1e9f;
+                for (auto& kv: perState){ lo=min(lo, kv.second); hi=max(hi, kv.second); }
+                if (!(lo<hi)) { lo=0.f; hi=10.f; }
+                legendLo = lo; legendHi = hi;
+                for (int i=0;i<5;i++){
+                    float a = lo + (hi-lo)* (i/5.f);
+                    float b = lo + (hi-lo)* ((i+1)/5.f);
+                    swatchText[i].setString(fmtNum(a) + " - " + fmtNum(b));
+                }
+                stateColorLUT.clear();
+                changed.clear();
+                for (auto& kv: perState) changed.push_back(kv.first);
             }
             // LUT
-            stateColorLUT.clear();
-            for (auto& kv: perState){
-                auto itKey = abbrToColor.find(kv.first);
+            vector<unsigned> changedKeys;
+            for (auto& ab: changed){
+                auto itKey = abbrToColor.find(ab);
                 if (itKey==abbrToColor.end()) continue;
-                int bi = bucketIndex(kv.second, lo, hi, 5);
+                int bi = bucketIndex(perState[ab], legendLo, legendHi, 5);
                 if (bi<0) bi=0; if (bi>4) bi=4;
                 stateColorLUT[itKey->second] = shade[4-bi];
+                changedKeys.push_back(itKey->second);
             }
-            // paint once
-            repaintFromLabels(labelImage, borderMask, imgW, imgH, stateColorLUT, coloredImage);
-            mapTexture.loadFromImage(coloredImage); mapTexture.setSmooth(false);
-            mapSprite.setTexture(mapTexture, true);
-            mapSprite.setScale(scale, scale);
-            mapSprite.setPosition(mapX, mapY);
-        }
+            if (full){
+                repaintFromLabels(labelImage, borderMask, imgW, imgH, stateColorLUT, coloredImage);
+                mapTexture.loadFromImage(coloredImage); mapTexture.setSmooth(false);
+                mapSprite.setTexture(mapTexture, true);
+                mapSprite.setScale(scale, scale);
+                mapSprite.setPosition(mapX, mapY);
+                painted = true;
+            } else {
+                repaintStates(labelImage, borderMask, imgW, imgH, stateColorLUT, changedKeys, coloredImage);
+                mapTexture.update(coloredImage);
+            }
+        };
+        // mapIdx 0 is the NEED index, then attrList, then formulas, in mapYear (0 = latest year)
+        size_t mapIdx = 0;
+        int mapYear = 0;
+        auto recolorMap = [&](shared_ptr<const Dataset> d){
+            if (mapIdx == 0){
+                executor.cancel(kMapChannel);
+                colorStates(d->stateData);
+                legendTitle.setString("Key based on our Need Index");
+                mapBtn.label.setString("Map: NEED index");
+                return;
+            }
+            // State means of a whole attribute or formula column: computed on a worker,
+            // the map keeps its current colors until they arrive
+            int year = mapYear ? mapYear : d->series.lastYear();
+            const formula* f = nullptr;
+            string attr, title, label;
+            if (mapIdx > attrList.size()){
+                const auto& nf = formulas[mapIdx - 1 - attrList.size()];
+                f = &nf.second;
+                title = "Key: state mean of formula, " + to_string(year);
+                label = "Map: " + nf.first + " (formula) " + to_string(year);
+            } else {
+                attr = attrList[mapIdx - 1];
+                title = "Key: state mean, " + to_string(year);
+                label = "Map: " + attr + " " + to_string(year);
+            }
+            mapBtn.label.setString(label + "  ...");
+            executor.submit(kMapChannel, [&, d, year, f, attr, title, label](const queryExecutor::Context& ctx){
+                TRACE_SCOPE("mapQuery");
+                vector<float> values(geography::kStateCount, NAN);
+                if (f){
+                    vector<float> counties;
+                    if (f->evaluate(d->series, year, counties) && !ctx.cancelled()) d->series.stateMeansOf(counties, values.data());
+                } else {
+                    d->series.stateMeans(attr, year, values.data());
+                }
+                ctx.post([&, values = std::move(values), title, label]{
+                    colorStates(values);
+                    legendTitle.setString(title);
+                    mapBtn.label.setString(label);
+                });
+            });
+        };
+        int shownVersion = store.snapshot()->version;
+        recolorMap(store.snapshot());
 
         // Hover tooltip
         sf::Text tip; tip.setFont(uiFont); tip.setCharacterSize(14); tip.setFillColor(sf::Color::White);
@@ -467,182 +770,393 @@ namespace Visualization {
             return ab + " - " + fmtNum(it->second);
         };
 
-        // Search
+        // Search. Inputs are read here; the lookups, the ranking and the sparkline run on a worker
+        // and stream back in that order, so the value shows up before the slower panels.
+        auto cancelSearch = [&](){
+            executor.cancel(kSearchChannel);
+            if (outputText.getString() == "...") outputText.setString("");
+            if (cxText.getString() == kBenchRunning) cxText.setString("Hash:   time - ms \nN-ary tree: time - ms");
+        };
         auto doSearch = [&](){
+            TRACE_SCOPE("doSearch");
+            shared_ptr<const Dataset> data = store.snapshot();
             string yearStr = trim(yearInput.value);
             string st2 = trim(stateInput.value);
             string county = trim(countyInput.value);
-            string attribute = kAttributes[attrIdx];
+            string attribute = attrList[attrIdx];
+            bool derived = attrIdx >= rawCount;
 
             if (yearStr.empty() || st2.size()!=2 || county.empty()){
+                cancelSearch();
                 outputText.setString("");
                 cxText.setString("Hash:   time - ms \nN-ary tree: time - ms");
                 return;
             }
 
-            string attrHash = (attribute == "Unemployment_Rate") ? "Unemployment_rate" : attribute;
-            string attrTree = attrHash;
-
-            auto trim_ic = [](string s){
-                auto issp=[](unsigned char c){ return isspace(c)!=0; };
-                s.erase(s.begin(), find_if(s.begin(), s.end(), [&](char c){ return !issp((unsigned char)c); }));
-                s.erase(find_if(s.rbegin(), s.rend(), [&](char c){ return !issp((unsigned char)c); }).base(), s.end());
-                return s;
-            };
-            auto toLower = [](string s){ for (char& c: s) c=(char)tolower((unsigned char)c); return s; };
-            auto ends_with_ic = [&](const string& s, const string& suf){
-                string A = toLower(s), B = toLower(suf);
-                if (B.size()>A.size()) return false;
-                return equal(B.rbegin(), B.rend(), A.rbegin());
-            };
-            auto titleCase = [](string s){
-                bool nw=true;
-                for (char& c: s){
-                    unsigned char uc=c;
-                    if (isalpha(uc)){
-                        c = nw ? (char)toupper(uc) : (char)tolower(uc);
-                        nw=false;
-                    }else{
-                        nw = (c==' '||c=='-'||c=='\t');
-                    }
-                }
-                return s;
-            };
-            auto isNA = [&](const string& s){
-                string t = toLower(trim_ic(s));
-                return t.empty() ||
-                       t=="n/a" || t=="na" || t=="null" || t=="none" || t=="notfound" || t=="no data" || t=="missing";
-            };
-
-            vector<string> countyCands;
-            string c0 = trim_ic(county);
-            string c1 = titleCase(c0);
-            countyCands.push_back(c0);
-            if (!ends_with_ic(c0, " county")) countyCands.push_back(c0 + " County");
-            if (c1 != c0) {
-                countyCands.push_back(c1);
-                if (!ends_with_ic(c1, " county")) countyCands.push_back(c1 + " County");
+            // The map follows the searched year
+            int year = atoi(yearStr.c_str());
+            if (mapIdx != 0 && year != mapYear){
+                mapYear = year;
+                painted = false;
+                recolorMap(data);
             }
+            outputText.setString("...");
+
+            executor.submit(kSearchChannel, [&, data, yearStr, st2, county, attribute, derived, year](const queryExecutor::Context& ctx){
+                TRACE_SCOPE("searchQuery");
+                const Tree& tree = data->tree;
+                const hashTable& hashData = data->hashData;
+                const bloomFilter& filter = data->keyFilter;
 
-            auto timeCall = [&](auto&& fn)->pair<string,double>{
-                auto tA = std::chrono::steady_clock::now();
-                string v = fn();
-                auto tB = std::chrono::steady_clock::now();
-                double ms = std::chrono::duration<double, std::milli>(tB - tA).count();
-                return {v, ms};
-            };
-            auto [hv, hms] = timeCall([&](){
-                for (const auto& c : countyCands){
-                    string v = hashData.search(st2, c, attrHash, yearStr);
-                    if (!isNA(v)) return v;
+                auto trim_ic = [](string s){
+                    auto issp=[](unsigned char c){ return isspace(c)!=0; };
+                    s.erase(s.begin(), find_if(s.begin(), s.end(), [&](char c){ return !issp((unsigned char)c); }));
+                    s.erase(find_if(s.rbegin(), s.rend(), [&](char c){ return !issp((unsigned char)c); }).base(), s.end());
+                    return s;
+                };
+                // Match the typed county against the index instead of guessing spellings
+                int countyId = data->counties.resolve(geography::stateIdFromAbbrev(st2), trim_ic(county));
+                if (countyId < 0){
+                    ctx.post([&]{
+                        outputText.setString("No such county");
+                        cxText.setString("Hash:   time - ms \nN-ary tree: time - ms");
+                    });
+                    return;
                 }
-                if (attrHash=="Unemployment_rate"){
-                    for (const auto& c : countyCands){
-                        string v = hashData.search(st2, c, "Unemployment_Rate", yearStr);
-                        if (!isNA(v)) return v;
-                    }
+                // Both structures are keyed on the full name, parishes and boroughs included
+                const string& countyName = data->counties.counties()[countyId].name;
+
+                // Derived series only live in the series store
+                if (derived){
+                    auto tA = std::chrono::steady_clock::now();
+                    float v = data->series.value(attribute, countyId, year);
+                    auto tB = std::chrono::steady_clock::now();
+                    char buf[160];
+                    snprintf(buf, sizeof(buf), "Series store: time %.3f ms\n(derived series, not in hash table or tree)",
+                             std::chrono::duration<double, std::milli>(tB - tA).count());
+                    ctx.post([&, v, text = string(buf)]{
+                        outputText.setString(std::isnan(v) ? "" : fmtNum(v));
+                        sparkCounty.clear(); sparkState.clear(); showSparkDot = false;
+                        cxText.setString(text);
+                    });
+                    return;
                 }
-                return string("");
-            });
 
-            auto [tv, tms] = timeCall([&](){
-                for (const auto& c : countyCands){
-                    string v = tree.searchValue(st2, c, attrTree, yearStr);
-                    if (!isNA(v)) return v;
+                // One filter probe per search, made only if some structure is actually searched.
+                // A key it lets through that the searched structures miss is a false positive.
+                int filterSays = -1;
+                bool found = false, missed = false;
+                auto mayHold = [&]{
+                    if (filterSays < 0) filterSays = filter.mightContain(st2, countyName, attribute, yearStr) ? 1 : 0;
+                    return filterSays == 1;
+                };
+                auto record = [&](bool hit){ (hit ? found : missed) = true; };
+
+                // Cache hits are reported as such; only real structure searches are timed
+                struct Timed { string v; double ms = 0.0; bool cached = false; };
+                auto timed = [&](queryCache& cache, auto&& search){
+                    Timed r;
+                    r.cached = cache.get(data->version, st2, countyName, attribute, yearStr, r.v);
+                    if (r.cached) return r;
+                    auto tA = std::chrono::steady_clock::now();
+                    r.v = search();
+                    auto tB = std::chrono::steady_clock::now();
+                    r.ms = std::chrono::duration<double, std::milli>(tB - tA).count();
+                    cache.put(data->version, st2, countyName, attribute, yearStr, r.v);
+                    return r;
+                };
+                const string key = hashTable::makeKey(st2, countyName, attribute, yearStr);
+                Timed hr = timed(hashCache, [&]()->string{
+                    TRACE_SCOPE("hashSearch");
+                    if (!mayHold()) return "";
+                    const string* v = hashData.lookup(key, hashTable::hash(key));
+                    record(v != nullptr);
+                    return v ? *v : "";
+                });
+                const Tree::StateRef stateRef = tree.stateRef(st2);
+                Timed tr = timed(treeCache, [&]()->string{
+                    TRACE_SCOPE("treeSearch");
+                    if (!mayHold()) return "";
+                    float v = tree.value(stateRef, countyName, attribute, year);
+                    record(!isnan(v));
+                    return isnan(v) ? "" : to_string(v);
+                });
+                if (missed && !found) filter.reportFalsePositive();
+
+                string shown = !hr.v.empty() ? hr.v : tr.v;
+                bloomFilter::Stats fs = filter.stats();
+                queryCache::Stats hc = hashCache.stats(), tc = treeCache.stats();
+                auto timing = [](const Timed& t){
+                    if (t.cached) return string("cached");
+                    char b[48];
+                    snprintf(b, sizeof(b), "time %.3f ms", t.ms);
+                    return string(b);
+                };
+                char buf[280];
+                snprintf(buf, sizeof(buf), "Hash:   %s\nN-ary tree: %s\nFilter: %zu/%zu probes skipped, FPR %.2f%% (exp %.2f%%)\n"
+                         "Cache: hash %.0f%% of %zu, tree %.0f%% of %zu hit (%zu/%zu)",
+                         timing(hr).c_str(), timing(tr).c_str(), fs.rejected, fs.queries, fs.observedFpr() * 100.0, fs.expectedFpr * 100.0,
+                         hc.hitRate() * 100.0, hc.hits + hc.misses, tc.hitRate() * 100.0, tc.hits + tc.misses, hc.size, hc.capacity);
+                ctx.post([&, shown, text = string(buf)]{
+                    outputText.setString(shown);
+                    cxText.setString(text);
+                });
+                if (ctx.cancelled()) return;
+
+                // Where this county sits among all counties for the same attribute and year
+                const rankIndex& ranks = data->ranks;
+                if (const vector<rankIndex::Entry>* col = ranks.column(attribute, year)){
+                    const int kShow = 3;
+                    rankIndex::Entry top[kShow], bottom[kShow];
+                    size_t nTop = ranks.top(attribute, year, kShow, top);
+                    size_t nBottom = ranks.bottom(attribute, year, kShow, bottom);
+                    const auto& names = data->counties.counties();
+                    string r = attribute + " " + yearStr + " (" + to_string(col->size()) + " counties)\nHighest:\n";
+                    for (size_t i=0;i<nTop;i++)
+                        r += "  " + string(geography::kStates[names[top[i].county].stateId].abbrev) + " " + names[top[i].county].name + "  " + fmtNum(top[i].value) + "\n";
+                    r += "Lowest:\n";
+                    for (size_t i=0;i<nBottom;i++)
+                        r += "  " + string(geography::kStates[names[bottom[i].county].stateId].abbrev) + " " + names[bottom[i].county].name + "  " + fmtNum(bottom[i].value) + "\n";
+                    float pct = ranks.percentile(attribute, year, countyId);
+                    if (!isnan(pct)){
+                        char pbuf[96];
+                        snprintf(pbuf, sizeof(pbuf), "%s: #%zu, percentile %.1f", names[countyId].name.c_str(),
+                                 ranks.rankFromTop(attribute, year, countyId), pct);
+                        r += pbuf;
+                    }
+                    ctx.post([&, r]{
+                        rankText.setString(r);
+                        showRankPanel = true;
+                    });
                 }
-                if (attrTree=="Unemployment_rate"){
-                    for (const auto& c : countyCands){
-                        string v = tree.searchValue(st2, c, "Unemployment_Rate", yearStr);
-                        if (!isNA(v)) return v;
+                if (ctx.cancelled()) return;
+
+                // Whole series of the county and the state mean over the same years
+                vector<sf::Vertex> countyLine, stateLine;
+                bool dot = false;
+                sf::Vector2f dotPos;
+                Tree::SeriesView series = tree.range(st2, countyName, attribute, 0, 9999);
+                if (!series.values.empty()){
+                    float stateMean[kSparkYears];
+                    size_t n = min(series.values.size(), kSparkYears);
+                    int lastYear = series.firstYear + int(n) - 1;
+                    tree.stateRange(st2, attribute, series.firstYear, lastYear, Tree::Aggregate::Mean, stateMean);
+                    float lo = INFINITY, hi = -INFINITY;
+                    for (size_t i=0;i<n;i++){
+                        for (float v : {series.values[i], stateMean[i]}){
+                            if (isnan(v)) continue;
+                            lo = min(lo, v); hi = max(hi, v);
+                        }
+                    }
+                    if (hi == lo){ hi += 1.f; lo -= 1.f; }
+                    auto point = [&](size_t i, float v){
+                        float x = sparkArea.left + (n > 1 ? sparkArea.width * float(i) / float(n - 1) : sparkArea.width * 0.5f);
+                        float yy = sparkArea.top + sparkArea.height * (1.f - (v - lo) / (hi - lo));
+                        return sf::Vector2f(x, yy);
+                    };
+                    auto addSegments = [&](vector<sf::Vertex>& va, const float* v, sf::Color c){
+                        for (size_t i=1;i<n;i++){
+                            if (isnan(v[i-1]) || isnan(v[i])) continue;
+                            va.push_back(sf::Vertex(point(i-1, v[i-1]), c));
+                            va.push_back(sf::Vertex(point(i, v[i]), c));
+                        }
+                    };
+                    addSegments(stateLine, stateMean, sf::Color(120,125,140));
+                    addSegments(countyLine, series.values.data(), sf::Color(120,160,255));
+                    int yi = year - series.firstYear;
+                    if (yi >= 0 && yi < int(n) && !isnan(series.values[yi])){
+                        dotPos = point(size_t(yi), series.values[yi]);
+                        dot = true;
                     }
                 }
-                return string("");
+                // The vertex arrays keep their capacity, so applying this does not allocate
+                ctx.post([&, countyLine, stateLine, dot, dotPos]{
+                    sparkCounty.clear(); sparkState.clear();
+                    for (const sf::Vertex& v : stateLine) sparkState.append(v);
+                    for (const sf::Vertex& v : countyLine) sparkCounty.append(v);
+                    sparkDot.setPosition(dotPos);
+                    showSparkDot = dot;
+                });
             });
+        };
 
-            string shown = !isNA(hv) ? hv : (!isNA(tv) ? tv : "");
-            outputText.setString(shown);
+        // Benchmark: the current query many times per structure on a worker, warm and cache-cold,
+        // so the panel shows distributions instead of one cold call. Cancelled like a search.
+        auto doBench = [&](){
+            shared_ptr<const Dataset> data = store.snapshot();
+            string yearStr = trim(yearInput.value);
+            string st2 = trim(stateInput.value);
+            string county = trim(countyInput.value);
+            string attribute = attrList[attrIdx];
+            if (yearStr.empty() || st2.size()!=2 || county.empty()){
+                cxText.setString("Benchmark: enter a year, state and county");
+                return;
+            }
+            if (attrIdx >= rawCount){
+                cxText.setString("Benchmark: derived series are not in\nthe hash table or tree");
+                return;
+            }
+            cxText.setString(kBenchRunning);
 
-            char buf[160];
-            snprintf(buf, sizeof(buf), "Hash:   time %.3f ms\nN-ary tree: time %.3f ms", hms, tms);
-            cxText.setString(buf);
+            executor.submit(kSearchChannel, [&, data, st2, county, attribute, year = atoi(yearStr.c_str())](const queryExecutor::Context& ctx){
+                TRACE_SCOPE("lookupBenchmark");
+                int countyId = data->counties.resolve(geography::stateIdFromAbbrev(st2), county);
+                if (countyId < 0){
+                    ctx.post([&]{ cxText.setString("Benchmark: no such county"); });
+                    return;
+                }
+                const int kWarmRuns = 20000, kColdRuns = 100;
+                LookupBenchmark b = benchmarkLookup(data->hashData, data->tree, st2, data->counties.counties()[countyId].name, attribute, year,
+                                                    kWarmRuns, kColdRuns, [&]{ return ctx.cancelled(); });
+                if (!b.finished) return;
+                char buf[280];
+                snprintf(buf, sizeof(buf), "Benchmark: %d warm, %d cold runs, -%.0f ns clock%s\n"
+                         "Hash  warm %.0f/%.0f/%.0f  cold %.0f/%.0f/%.0f\n"
+                         "Tree  warm %.0f/%.0f/%.0f  cold %.0f/%.0f/%.0f\n"
+                         "ns p50/p99/per op; hash probes %d, tree visits %d",
+                         b.warmRuns, b.coldRuns, b.clockNs, b.found ? "" : " (miss)",
+                         b.hashWarm.p50, b.hashWarm.p99, b.hashWarm.nsPerOp, b.hashCold.p50, b.hashCold.p99, b.hashCold.nsPerOp,
+                         b.treeWarm.p50, b.treeWarm.p99, b.treeWarm.nsPerOp, b.treeCold.p50, b.treeCold.p99, b.treeCold.nsPerOp,
+                         b.hashProbes, b.treeVisits);
+                ctx.post([&, text = string(buf)]{ cxText.setString(text); });
+            });
         };
 
         // Event loop
         while (win.isOpen()){
+            TRACE_SCOPE("frame");
+            {
+                // Pick up a reloaded dataset
+                shared_ptr<const Dataset> data = store.snapshot();
+                if (data->version != shownVersion){
+                    shownVersion = data->version;
+                    recolorMap(data);
+                    header.setString("US Map - NEED Index  (data v" + to_string(shownVersion) + ")");
+                }
+            }
             sf::Event e;
-            while (win.pollEvent(e)){
-                if (e.type==sf::Event::Closed) win.close();
-                if (e.type==sf::Event::KeyPressed && e.key.code==sf::Keyboard::Escape) win.close();
-
-                if (e.type==sf::Event::MouseButtonPressed && e.mouseButton.button==sf::Mouse::Left){
-                    sf::Vector2f m(float(e.mouseButton.x), float(e.mouseButton.y));
-                    auto clearFocus=[&](){ yearInput.setFocused(false); stateInput.setFocused(false); countyInput.setFocused(false); };
-                    if (yearInput.contains(m)){ clearFocus(); yearInput.setFocused(true); }
-                    else if (stateInput.contains(m)){ clearFocus(); stateInput.setFocused(true); }
-                    else if (countyInput.contains(m)){ clearFocus(); countyInput.setFocused(true); }
-                    else clearFocus();
-
-                    if (attrBtn.contains(m)){ attrIdx = (attrIdx + 1) % kAttributes.size();
-                        attrBtn.label.setString(string("Attribute: ") + kAttributes[attrIdx]);
+            {
+                TRACE_SCOPE("events");
+                while (win.pollEvent(e)){
+                    if (e.type==sf::Event::Closed) win.close();
+                    if (e.type==sf::Event::KeyPressed && e.key.code==sf::Keyboard::Escape) win.close();
+                    if (e.type==sf::Event::KeyPressed && e.key.code==sf::Keyboard::F3) showMemPanel = !showMemPanel;
+                    if (e.type==sf::Event::KeyPressed && e.key.code==sf::Keyboard::F4) showRankPanel = !showRankPanel;
+
+                    if (e.type==sf::Event::MouseButtonPressed && e.mouseButton.button==sf::Mouse::Left){
+                        sf::Vector2f m(float(e.mouseButton.x), float(e.mouseButton.y));
+                        if (countyInput.focused && suggestCount > 0 && suggestBg.getGlobalBounds().contains(m)){
+                            acceptSuggestion(min(suggestCount - 1, size_t((m.y - suggestBg.getPosition().y) / kSuggestRow)));
+                            continue;
+                        }
+                        auto clearFocus=[&](){ yearInput.setFocused(false); stateInput.setFocused(false); countyInput.setFocused(false); };
+                        if (yearInput.contains(m)){ clearFocus(); yearInput.setFocused(true); }
+                        else if (stateInput.contains(m)){ clearFocus(); stateInput.setFocused(true); }
+                        else if (countyInput.contains(m)){ clearFocus(); countyInput.setFocused(true); }
+                        else clearFocus();
+
+                        if (attrBtn.contains(m)){ attrIdx = (attrIdx + 1) % attrList.size();
+                            cancelSearch();   // its result is for the old attribute
+                            attrBtn.label.setString(string("Attribute: ") + attrList[attrIdx]);
+                        }
+                        if (searchBtn.contains(m)) doSearch();
+                        if (benchBtn.contains(m)) doBench();
+                        if (mapBtn.contains(m)){
+                            mapIdx = (mapIdx + 1) % (attrList.size() + formulas.size() + 1);
+                            painted = false;   // new legend range
+                            recolorMap(store.snapshot());
+                        }
+                    }
+                    if (e.type==sf::Event::TextEntered){
+                        yearInput.handleText(e.text.unicode);
+                        stateInput.handleText(e.text.unicode);
+                        countyInput.handleText(e.text.unicode);
+                        if (stateInput.focused || countyInput.focused) refreshSuggestions();
+                        cancelSearch();   // the inputs no longer match the running search
+                    }
+                    if (e.type==sf::Event::KeyPressed && e.key.code==sf::Keyboard::Tab && countyInput.focused && suggestCount > 0){
+                        acceptSuggestion(0);
+                    }
+                    if (e.type==sf::Event::KeyPressed && e.key.code==sf::Keyboard::Enter){
+                        if (yearInput.focused || stateInput.focused || countyInput.focused) doSearch();
                     }
-                    if (searchBtn.contains(m)) doSearch();
                 }
-                if (e.type==sf::Event::TextEntered){
-                    yearInput.handleText(e.text.unicode);
-                    stateInput.handleText(e.text.unicode);
-                    countyInput.handleText(e.text.unicode);
+            }
+
+            {
+                TRACE_SCOPE("query results");
+                executor.drain();
+            }
+
+            {
+                TRACE_SCOPE("draw");
+                win.clear(WINDOW_BG);
+                win.draw(header);
+                win.draw(mapBtn.box); win.draw(mapBtn.label);
+                win.draw(mapSprite);
+                win.draw(sidebarPanel);
+                win.draw(about);
+                yearInput.draw(win);
+                stateInput.draw(win);
+                countyInput.draw(win);
+                win.draw(attrBtn.box);  win.draw(attrBtn.label);
+                win.draw(searchBtn.box);  win.draw(searchBtn.label);
+                win.draw(benchBtn.box);  win.draw(benchBtn.label);
+                win.draw(outputPanel); win.draw(outputText);
+                win.draw(sparkState); win.draw(sparkCounty);
+                if (showSparkDot) win.draw(sparkDot);
+                win.draw(cxPanel); win.draw(cxText);
+                win.draw(legendPanel);
+                if (showMemPanel){
+                    memText.setString("Live memory by structure (F3)\n" + memoryStats::summary());
+                    win.draw(memText);
+                } else if (showRankPanel){
+                    win.draw(rankText);
+                } else {
+                    win.draw(legendTitle);
+                    for (int i=0;i<5;i++){ win.draw(swatch[i]); win.draw(swatchText[i]); }
                 }
-                if (e.type==sf::Event::KeyPressed && e.key.code==sf::Keyboard::Enter){
-                    if (yearInput.focused || stateInput.focused || countyInput.focused) doSearch();
+                if (countyInput.focused && suggestCount > 0){
+                    win.draw(suggestBg);
+                    for (size_t i=0;i<suggestCount;i++) win.draw(suggestText[i]);
                 }
-            }
 
-            win.clear(WINDOW_BG);
-            win.draw(header);
-            win.draw(mapSprite);
-            win.draw(sidebarPanel);
-            win.draw(about);
-            yearInput.draw(win);
-            stateInput.draw(win);
-            countyInput.draw(win);
-            win.draw(attrBtn.box);  win.draw(attrBtn.label);
-            win.draw(searchBtn.box);  win.draw(searchBtn.label);
-            win.draw(outputPanel); win.draw(outputText);
-            win.draw(cxPanel); win.draw(cxText);
-            win.draw(legendPanel); win.draw(legendTitle);
-            for (int i=0;i<5;i++){ win.draw(swatch[i]); win.draw(swatchText[i]); }
-
-            // Hover
-            string hover = "";
-            sf::Vector2i mp = sf::Mouse::getPosition(win);
-            float lx = (mp.x - mapSprite.getPosition().x) / scale;
-            float ly = (mp.y - mapSprite.getPosition().y) / scale;
-            if (lx>=0 && ly>=0 && lx<(float)imgW && ly<(float)imgH){
-                unsigned ix = (unsigned)lx, iy = (unsigned)ly;
-                unsigned key = labelImage[iy*imgW + ix];
-                if (key != 0){
-                    auto it = colorToAbbr.find(key);
-                    if (it!=colorToAbbr.end()){
-                        string ab = it->second;
-                        string name = abbrName.count(ab)? abbrName[ab] : ab;
-                        string stat = getStateStatString(ab);
-                        hover = name + "  (" + stat + ")";
+                // Hover
+                string hover = "";
+                sf::Vector2i mp = sf::Mouse::getPosition(win);
+                float lx = (mp.x - mapSprite.getPosition().x) / scale;
+                float ly = (mp.y - mapSprite.getPosition().y) / scale;
+                if (lx>=0 && ly>=0 && lx<(float)imgW && ly<(float)imgH){
+                    unsigned ix = (unsigned)lx, iy = (unsigned)ly;
+                    unsigned key = labelImage[iy*imgW + ix];
+                    if (key != 0){
+                        auto it = colorToAbbr.find(key);
+                        if (it!=colorToAbbr.end()){
+                            string ab = it->second;
+                            int stateId = geography::stateIdFromAbbrev(ab);
+                            string name = stateId >= 0 ? string(geography::kStates[stateId].name) : ab;
+                            string stat = getStateStatString(ab);
+                            hover = name + "  (" + stat + ")";
+                        }
                     }
                 }
-            }
-            if (!hover.empty()){
-                tip.setString(hover);
-                auto bounds = tip.getLocalBounds();
-                sf::Vector2f pos(float(mp.x)+14.f, float(mp.y)+14.f);
-                float w = bounds.width + 16.f, h = bounds.height + 10.f;
-                if (pos.x + w > WIN_W - 8) pos.x = WIN_W - 8 - w;
-                if (pos.y + h > WIN_H - 8) pos.y = WIN_H - 8 - h;
-                tipBg.setPosition(pos); tipBg.setSize({w,h});
-                tip.setPosition(pos.x + 8.f - bounds.left, pos.y + 5.f - bounds.top);
-                win.draw(tipBg); win.draw(tip);
+                if (!hover.empty()){
+                    tip.setString(hover);
+                    auto bounds = tip.getLocalBounds();
+                    sf::Vector2f pos(float(mp.x)+14.f, float(mp.y)+14.f);
+                    float w = bounds.width + 16.f, h = bounds.height + 10.f;
+                    if (pos.x + w > WIN_W - 8) pos.x = WIN_W - 8 - w;
+                    if (pos.y + h > WIN_H - 8) pos.y = WIN_H - 8 - h;
+                    tipBg.setPosition(pos); tipBg.setSize({w,h});
+                    tip.setPosition(pos.x + 8.f - bounds.left, pos.y + 5.f - bounds.top);
+                    win.draw(tipBg); win.draw(tip);
+                }
             }
 
-            win.display();
+            {
+                TRACE_SCOPE("display");
+                win.display();
+            }
         }
 
         return 0;
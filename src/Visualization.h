@@ -1,18 +1,47 @@
 #pragma once
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
+#include <SFML/Graphics/Image.hpp>
 #include "tree.h"
 #include "hashTable.h"
+#include "dataset.h"
 
 namespace Visualization {
 
+// State id raster built from usa_color_ids.png + ids.csv.
+// Kept outside the window code so the benchmark can prepare it headless.
+    struct MapRaster {
+        sf::Image idImage;
+        std::unordered_map<unsigned,std::string> colorToAbbr;
+        std::unordered_map<std::string,unsigned> abbrToColor;
+        std::vector<unsigned> keys;
+        unsigned W = 0, H = 0;
+        std::vector<unsigned> labels;        // packed RGB state key per pixel, 0 = outside
+        std::vector<unsigned char> border;   // 1 where a pixel touches another state
+    };
+
+// Map preparation steps, in order. loadMapRaster returns false on missing assets.
+    bool loadMapRaster(MapRaster& map);
+    void classifyMapRaster(MapRaster& map);
+    void buildMapBorders(MapRaster& map);
+
+// Headless batch export: a PNG of the state-mean map (same shading as the
+// window) for every year of every series attribute and saved formula, written
+// to outDir on `threads` threads (0 = all cores), plus outDir/index.csv with
+// each map's legend range. Needs no window. Returns 0 if every map was written.
+    int exportMaps(const Dataset& data, const MapRaster& map, const std::string& outDir, int threads);
+
 // Runs the full SFML UI and event loop.
-// - Colors the US map by Unemployment_Rate for the selected year
-// - Attribute toggle affects the point lookup only (map always uses Unemployment_Rate)
-// - Output shows ONLY the numeric value returned by hashData.search(...)
+// - Colors the US map by the NEED index; the map button cycles through the state
+//   means of every attribute and saved formula for the searched year
+// - County box suggests matching county names as you type
+// - Output shows the hash table's value, the tree's if the hash has none, or the
+//   series store's for derived attributes, with lookup timings, ranks and a sparkline
+// - Benchmark button times the current query in the hash table and the tree
+// - Reads the current Dataset from store every frame, so reloads show up live
 // Returns 0 on normal window close, nonzero on asset/load errors.
-    int visualizer(
-            Tree tree, hashTable hashData, std::vector<float> stateData
-    );
+    int visualizer(DatasetStore& store);
 
 } // namespace Visualization
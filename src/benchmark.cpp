@@ -0,0 +1,723 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include "benchmark.h"
+#include "dataLoader.h"
+#include "memoryStats.h"
+#include "Visualization.h"
+#include "countyIndex.h"
+#include "seriesStore.h"
+#include "correlation.h"
+#include "seriesKernels.h"
+#include "geography.h"
+
+using namespace std;
+
+namespace {
+
+    struct PhaseResult {
+        string name;
+        vector<double> ms;    //one entry per run
+        size_t allocs = 0;    //allocations in the last run
+        size_t bytes = 0;     //bytes requested in the last run
+    };
+
+    double median(vector<double> v) {
+        if (v.empty()) return 0.0;
+        sort(v.begin(), v.end());
+        size_t n = v.size();
+        return (n % 2) ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+    }
+
+    //Baseline file: one "phase medianMs allocs" line per phase, '#' comments
+    map<string, pair<double, size_t>> readBaseline(const string& path) {
+        map<string, pair<double, size_t>> out;
+        ifstream in(path);
+        string line;
+        while (getline(in, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            stringstream ss(line);
+            string name; double ms; size_t allocs;
+            if (ss >> name >> ms >> allocs) out[name] = {ms, allocs};
+        }
+        return out;
+    }
+
+    bool writeBaseline(const string& path, const vector<PhaseResult>& phases) {
+        ofstream out(path);
+        if (!out) return false;
+        out << "# phase medianMs allocs\n";
+        for (const auto& p : phases) {
+            out << p.name << " " << median(p.ms) << " " << p.allocs << "\n";
+        }
+        return true;
+    }
+
+} // namespace
+
+int runStartupBenchmark(int runs, const string& baselinePath, bool saveBaseline) {
+    if (runs < 1) runs = 1;
+    vector<PhaseResult> phases;
+    int hashBuckets = 0, hashResizes = 0;
+    size_t rowCount = 0;
+
+    auto phase = [&](size_t idx, const char* name, auto&& fn) {
+        if (phases.size() <= idx) phases.push_back({name, {}, 0, 0});
+        size_t a0 = memoryStats::allocationCount(), b0 = memoryStats::allocatedBytes();
+        auto tA = std::chrono::steady_clock::now();
+        fn();
+        auto tB = std::chrono::steady_clock::now();
+        PhaseResult& p = phases[idx];
+        p.ms.push_back(std::chrono::duration<double, std::milli>(tB - tA).count());
+        p.allocs = memoryStats::allocationCount() - a0;
+        p.bytes = memoryStats::allocatedBytes() - b0;
+    };
+
+    for (int run = 0; run < runs; ++run) {
+        vector<vector<string>> rows;
+        vector<Record> records;
+        AllData allData;
+        hashTable hashData;
+        Tree tree;
+        vector<float> stateData;
+        Visualization::MapRaster map;
+        bool csvOk = false, mapOk = false;
+
+        phase(0, "csv_read", [&]{ csvOk = readCSV(kDataPath, rows); });
+        if (!csvOk) {
+            cerr << "Error opening file." << endl;
+            return 1;
+        }
+        phase(1, "csv_parse", [&]{ records = parseRecords(rows, false); });
+        phase(2, "all_data", [&]{ buildAllData(records, allData); });
+        phase(3, "hash_insert", [&]{ buildHashTable(records, hashData); });
+        phase(4, "tree_build", [&]{ buildTree(allData, tree); });
+        phase(5, "display_data", [&]{ stateData = tree.getDisplayData(Schema::builtin()->needWeights); });
+        phase(6, "map_load", [&]{ mapOk = Visualization::loadMapRaster(map); });
+        if (mapOk) {
+            phase(7, "classify_labels", [&]{ Visualization::classifyMapRaster(map); });
+            phase(8, "border_mask", [&]{ Visualization::buildMapBorders(map); });
+        }
+
+        rowCount = rows.size();
+        hashBuckets = hashData.bucketCount();
+        hashResizes = hashData.resizeCount();
+        cout << "run " << (run + 1) << "/" << runs << " done" << endl;
+    }
+
+    cout << "\n=== Startup benchmark (" << runs << " runs, " << rowCount << " rows) ===\n";
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%-16s %10s %10s %12s %10s\n", "phase", "median ms", "min ms", "allocs", "MB");
+    cout << buf;
+    double totalMs = 0.0;
+    size_t totalAllocs = 0;
+    for (const auto& p : phases) {
+        double med = median(p.ms);
+        totalMs += med;
+        totalAllocs += p.allocs;
+        snprintf(buf, sizeof(buf), "%-16s %10.2f %10.2f %12zu %10.2f\n", p.name.c_str(), med,
+                 *min_element(p.ms.begin(), p.ms.end()), p.allocs, p.bytes / (1024.0 * 1024.0));
+        cout << buf;
+    }
+    snprintf(buf, sizeof(buf), "%-16s %10.2f %10s %12zu\n", "total", totalMs, "", totalAllocs);
+    cout << buf;
+    snprintf(buf, sizeof(buf), "hash table: %d buckets after %d resizes\npeak RSS: %.1f MB\n",
+             hashBuckets, hashResizes, memoryStats::peakRSS() / (1024.0 * 1024.0));
+    cout << buf;
+
+    if (baselinePath.empty()) return 0;
+
+    if (saveBaseline) {
+        if (!writeBaseline(baselinePath, phases)) {
+            cerr << "Cannot write baseline " << baselinePath << endl;
+            return 1;
+        }
+        cout << "Baseline written to " << baselinePath << endl;
+        return 0;
+    }
+
+    auto baseline = readBaseline(baselinePath);
+    if (baseline.empty()) {
+        cout << "No baseline at " << baselinePath << " (use --save-baseline to create one)" << endl;
+        return 0;
+    }
+
+    //A phase regresses when it is both >10% and >1 ms slower, or allocates >10% more
+    bool regressed = false;
+    cout << "\n=== Against baseline " << baselinePath << " ===\n";
+    for (const auto& p : phases) {
+        auto it = baseline.find(p.name);
+        if (it == baseline.end()) continue;
+        double med = median(p.ms);
+        double baseMs = it->second.first;
+        size_t baseAllocs = it->second.second;
+        double dMs = baseMs > 0.0 ? (med - baseMs) / baseMs * 100.0 : 0.0;
+        bool slow = dMs > 10.0 && med - baseMs > 1.0;
+        bool heavy = p.allocs > baseAllocs + baseAllocs / 10;
+        regressed = regressed || slow || heavy;
+        snprintf(buf, sizeof(buf), "%-16s %10.2f ms (%+6.1f%%) %12zu allocs%s\n", p.name.c_str(), med, dMs,
+                 p.allocs, (slow || heavy) ? "  REGRESSION" : "");
+        cout << buf;
+    }
+    return regressed ? 2 : 0;
+}
+
+int runHashInsertBenchmark() {
+    vector<vector<string>> rows;
+    if (!readCSV(kDataPath, rows)) {
+        cerr << "Error opening file." << endl;
+        return 1;
+    }
+    vector<Record> records = parseRecords(rows, false);
+    vector<string> keys, values;
+    keys.reserve(records.size());
+    values.reserve(records.size());
+    for (const auto& r : records) {
+        keys.push_back(r.stateAbbrev + "," + r.county + "," + r.attribute + "," + to_string(r.year));
+        values.push_back(to_string(r.value));
+    }
+
+    struct Variant { const char* name; int rehashStep; bool reserve; };
+    const Variant variants[] = {
+        {"stop-the-world", 0, false},
+        {"incremental", 2, false},
+        {"reserve(n)", 2, true},
+    };
+
+    cout << "\n=== hashTable insert latency (" << keys.size() << " inserts) ===\n";
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%-16s %9s %9s %9s %11s %11s %10s %8s\n",
+             "variant", "p50 ns", "p99 ns", "p99.9 ns", "max ns", "total ms", "buckets", "resizes");
+    cout << buf;
+    for (const auto& v : variants) {
+        hashTable table;
+        table.setRehashStep(v.rehashStep);
+        if (v.reserve) table.reserve(static_cast<int>(keys.size()));
+        vector<double> ns(keys.size());
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto tA = std::chrono::steady_clock::now();
+            table.insert(keys[i], values[i]);
+            auto tB = std::chrono::steady_clock::now();
+            ns[i] = std::chrono::duration<double, std::nano>(tB - tA).count();
+        }
+        double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        sort(ns.begin(), ns.end());
+        auto pct = [&](double p){ return ns[min(ns.size() - 1, static_cast<size_t>(p * ns.size()))]; };
+        snprintf(buf, sizeof(buf), "%-16s %9.0f %9.0f %9.0f %11.0f %11.2f %10d %8d\n", v.name,
+                 pct(0.50), pct(0.99), pct(0.999), ns.back(), totalMs, table.bucketCount(), table.resizeCount());
+        cout << buf;
+    }
+    return 0;
+}
+
+int runShardedHashBenchmark(int maxThreads) {
+    vector<vector<string>> rows;
+    if (!readCSV(kDataPath, rows)) {
+        cerr << "Error opening file." << endl;
+        return 1;
+    }
+    vector<Record> rowRecords = parseRecords(rows, false);
+    if (maxThreads < 1) maxThreads = max(1u, thread::hardware_concurrency());
+
+    //Alias spellings can map two rows onto one key. Like buildAllData the last one
+    //wins, and only that one is inserted: racing inserts of one key would leave
+    //whichever thread got there first, and the check could not say which.
+    vector<Record> records;
+    unordered_map<string, size_t> slot;
+    for (const auto& r : rowRecords) {
+        auto [it, added] = slot.try_emplace(hashTable::makeKey(r.stateAbbrev, r.county, r.attribute, to_string(r.year)), records.size());
+        if (added) records.push_back(r);
+        else records[it->second] = r;
+    }
+
+    //Query parts prepared up front so the timed loops only search
+    struct Query { string state, county, attr, year, expected; };
+    vector<Query> queries;
+    queries.reserve(records.size());
+    for (const auto& r : records) {
+        queries.push_back({r.stateAbbrev, r.county, r.attribute, to_string(r.year), to_string(r.value)});
+    }
+    if (queries.empty()) {
+        cerr << "No rows to query." << endl;
+        return 1;
+    }
+
+    cout << "\n=== shardedHashTable scaling (" << records.size() << " distinct keys from " << rowRecords.size()
+         << " rows, " << queries.size() << " lookups) ===\n";
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%-8s %12s %14s %14s %12s\n", "threads", "build ms", "inserts/s", "lookups/s", "check");
+    cout << buf;
+    bool allOk = true;
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > maxThreads) threads = maxThreads;
+        shardedHashTable table;
+
+        //Readers hammer the table while it is being built; they may miss
+        //(not inserted yet) but must never see a wrong value.
+        atomic<bool> building{true};
+        atomic<size_t> wrong{0};
+        thread reader([&]{
+            size_t i = 0;
+            while (building.load(memory_order_relaxed)) {
+                const Query& q = queries[i++ % queries.size()];
+                string v = table.search(q.state, q.county, q.attr, q.year);
+                if (v != "Not found" && v != q.expected) wrong++;
+            }
+        });
+        auto tA = std::chrono::steady_clock::now();
+        buildShardedHashTable(records, table, threads);
+        auto tB = std::chrono::steady_clock::now();
+        building = false;
+        reader.join();
+        double buildMs = std::chrono::duration<double, std::milli>(tB - tA).count();
+
+        //Lock-free verification of every key, split across the same thread count
+        atomic<size_t> missing{0};
+        vector<thread> workers;
+        auto tC = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]{
+                size_t bad = 0;
+                for (size_t i = t; i < queries.size(); i += threads) {
+                    const Query& q = queries[i];
+                    if (table.search(q.state, q.county, q.attr, q.year) != q.expected) bad++;
+                }
+                missing += bad;
+            });
+        }
+        for (auto& w : workers) w.join();
+        auto tD = std::chrono::steady_clock::now();
+        double lookupMs = std::chrono::duration<double, std::milli>(tD - tC).count();
+
+        bool ok = missing == 0 && wrong == 0 && table.size() == static_cast<int>(records.size());
+        allOk = allOk && ok;
+        snprintf(buf, sizeof(buf), "%-8d %12.2f %14.0f %14.0f %12s\n", threads, buildMs,
+                 records.size() / (buildMs / 1000.0), queries.size() / (lookupMs / 1000.0), ok ? "OK" : "FAILED");
+        cout << buf;
+        if (!ok) {
+            cout << "  " << missing << " missing, " << wrong << " wrong values seen during build, size "
+                 << table.size() << endl;
+        }
+        if (threads == maxThreads) break;
+    }
+    return allOk ? 0 : 1;
+}
+
+int runCorrelationBenchmark(int maxThreads) {
+    vector<vector<string>> rows;
+    if (!readCSV(kDataPath, rows)) {
+        cerr << "Error opening file." << endl;
+        return 1;
+    }
+    AllData allData;
+    buildAllData(parseRecords(rows, false), allData);
+    countyIndex counties;
+    counties.build(allData);
+    seriesStore series;
+    series.build(allData, counties);
+    vector<float> scratch;
+    span<const float> m = series.matrix("Unemployment_rate", scratch);
+    if (m.empty()) {
+        cerr << "No Unemployment_rate series" << endl;
+        return 1;
+    }
+    if (maxThreads < 1) maxThreads = max(1u, thread::hardware_concurrency());
+    size_t C = series.countyCount(), Y = m.size() / C;
+
+    //Row-major county x year copy, then the same rows 10x with deterministic noise
+    vector<float> real(C * Y);
+    for (size_t c = 0; c < C; ++c) {
+        for (size_t y = 0; y < Y; ++y) real[c * Y + y] = m[y * C + c];
+    }
+    vector<float> synth(real.size() * 10);
+    uint32_t seed = 12345;
+    auto draw = [&]{ seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+    auto noise = [&]{ return draw() / float(1 << 24) - 0.5f; };
+    for (size_t k = 0; k < 10; ++k) {
+        for (size_t i = 0; i < real.size(); ++i) synth[k * real.size() + i] = k == 0 ? real[i] : real[i] * (1.0f + 0.2f * noise()) + noise();
+    }
+
+    //Sampled pairs against a scalar double Pearson, on the counties as they are and
+    //with gaps punched into every third row so the masked path is checked as well
+    vector<float> gappy = real;
+    for (size_t c = 0; c < C; c += 3) {
+        for (size_t y = draw() % 4; y < Y; y += 3 + draw() % 5) gappy[c * Y + y] = NAN;
+    }
+    double maxErr = 0.0;
+    size_t checked = 0, checkedGaps = 0;
+    for (const vector<float>* set : {&real, &gappy}) {
+        correlation::NormalizedRows R = correlation::normalizeRows(set->data(), C, Y, Y, 1);
+        vector<float> full = correlation::matrix(R, maxThreads);
+        for (size_t s = 0; s < 2000; ++s) {
+            size_t i = draw() % C, j = draw() % C;
+            const float* a = &(*set)[i * Y];
+            const float* b = &(*set)[j * Y];
+            double want = correlation::pearson(a, b, Y);
+            float got = full[i * C + j];
+            if (isnan(want) != isnan(got)) {
+                //Rows that are invalid on their own may still share two varying years
+                if (R.valid[i] && R.valid[j]) maxErr = INFINITY;
+                continue;
+            }
+            if (isnan(want)) continue;
+            maxErr = max(maxErr, fabs(want - got));
+            checked++;
+            if (any_of(a, a + Y, [](float v){ return isnan(v); }) || any_of(b, b + Y, [](float v){ return isnan(v); })) checkedGaps++;
+        }
+    }
+
+    cout << "\n=== Correlation engine (" << Y << " years, " << checked << " pairs checked, " << checkedGaps
+         << " with gaps, max error " << maxErr << ") ===\n";
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%-10s %-8s %12s %14s %10s %10s\n", "set", "threads", "ms", "pairs/s", "GFLOP/s", "check");
+    cout << buf;
+    bool allOk = maxErr < 1e-4;
+
+    struct Set { const char* name; const vector<float>* data; size_t rows; };
+    const Set sets[] = {{"counties", &real, C}, {"10x synth", &synth, C * 10}};
+    for (const auto& set : sets) {
+        correlation::NormalizedRows N = correlation::normalizeRows(set.data->data(), set.rows, Y, Y, 1);
+        vector<size_t> reference;
+        for (int threads = 1; ; threads *= 2) {
+            if (threads > maxThreads) threads = maxThreads;
+            //Histogram of r in 20 bins over [-1, 1]; must not depend on the thread count
+            vector<atomic<size_t>> bins(21);
+            auto tA = std::chrono::steady_clock::now();
+            correlation::pairwise(N, threads, [&](const correlation::Tile& t){
+                size_t local[21] = {0};
+                size_t w = t.j1 - t.j0;
+                for (size_t i = t.i0; i < t.i1; ++i) {
+                    for (size_t j = (t.i0 == t.j0) ? i + 1 : t.j0; j < t.j1; ++j) {
+                        float r = t.r[(i - t.i0) * w + (j - t.j0)];
+                        local[isnan(r) ? 20 : min<size_t>(19, static_cast<size_t>((r + 1.0f) * 10.0f))]++;
+                    }
+                }
+                for (int b = 0; b < 21; ++b) bins[b] += local[b];
+            });
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tA).count();
+            vector<size_t> counts;
+            for (auto& b : bins) counts.push_back(b.load());
+            if (reference.empty()) reference = counts;
+            bool ok = counts == reference;
+            allOk = allOk && ok;
+            double pairs = 0.5 * double(set.rows) * double(set.rows - 1);
+            snprintf(buf, sizeof(buf), "%-10s %-8d %12.2f %14.0f %10.2f %10s\n", set.name, threads, ms,
+                     pairs / (ms / 1000.0), pairs * 2.0 * N.stride / (ms * 1e6), ok ? "OK" : "FAILED");
+            cout << buf;
+            if (threads == maxThreads) break;
+        }
+    }
+    return allOk ? 0 : 1;
+}
+
+int runCodecBenchmark() {
+    vector<vector<string>> rows;
+    if (!readCSV(kDataPath, rows)) {
+        cerr << "Error opening file." << endl;
+        return 1;
+    }
+    AllData allData;
+    buildAllData(parseRecords(rows, false), allData);
+    countyIndex counties;
+    counties.build(allData);
+    seriesStore plain, compact;
+    plain.build(allData, counties);
+    compact.build(allData, counties, true);
+
+    const int reps = 50;
+    const size_t C = plain.countyCount();
+    const vector<string>& derived = plain.derivedAttributes();
+    vector<float> scratch, states(geography::kStateCount);
+    auto timeMs = [&](auto&& body) {
+        auto tA = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; ++r) body();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tA).count() / reps;
+    };
+    auto same = [](float a, float b) { return (isnan(a) && isnan(b)) || a == b; };
+
+    cout << "\n=== Compact series (" << C << " counties, " << plain.lastYear() - plain.firstYear() + 1 << " years, "
+         << reps << " reps) ===\n";
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%-38s %-13s %9s %9s %7s %9s %9s %9s %9s %6s\n", "attribute", "codec", "KB f32", "KB", "ratio",
+             "scan f32", "scan", "means f32", "means", "check");
+    cout << buf;
+    bool allOk = true;
+    size_t plainBytes = 0, compactBytes = 0;
+    for (const string& attr : plain.attributes()) {
+        if (find(derived.begin(), derived.end(), attr) != derived.end()) continue;
+        vector<float> unused;
+        span<const float> want = plain.matrix(attr, unused);
+        span<const float> got = compact.matrix(attr, scratch);
+        bool ok = got.size() == want.size();
+        for (size_t i = 0; ok && i < want.size(); ++i) ok = same(want[i], got[i]);
+        for (size_t s = 0; ok && s < 1000; ++s) {
+            int county = static_cast<int>((s * 7919) % C);
+            int year = plain.firstYear() + static_cast<int>(s % (plain.lastYear() - plain.firstYear() + 1));
+            ok = same(plain.value(attr, county, year), compact.value(attr, county, year));
+        }
+        allOk = allOk && ok;
+
+        //Whole-matrix mean as the range scan, then every year's state means
+        float mean, sd;
+        size_t n;
+        double scanPlain = timeMs([&]{ span<const float> m = plain.matrix(attr, unused); seriesKernels::meanStdDev(m.data(), m.size(), mean, sd, n); });
+        double scanCompact = timeMs([&]{ span<const float> m = compact.matrix(attr, scratch); seriesKernels::meanStdDev(m.data(), m.size(), mean, sd, n); });
+        double meansPlain = timeMs([&]{ for (int y = plain.firstYear(); y <= plain.lastYear(); ++y) plain.stateMeans(attr, y, states.data()); });
+        double meansCompact = timeMs([&]{ for (int y = plain.firstYear(); y <= plain.lastYear(); ++y) compact.stateMeans(attr, y, states.data()); });
+
+        size_t fb = plain.byteSize(attr), cb = compact.byteSize(attr);
+        plainBytes += fb;
+        compactBytes += cb;
+        snprintf(buf, sizeof(buf), "%-38s %-13s %9zu %9zu %6.1fx %9.3f %9.3f %9.3f %9.3f %6s\n", attr.c_str(),
+                 columnCodec::codecName(compact.codecOf(attr)), fb / 1024, cb / 1024, double(fb) / max<size_t>(1, cb),
+                 scanPlain, scanCompact, meansPlain, meansCompact, ok ? "OK" : "FAILED");
+        cout << buf;
+    }
+    cout << "Raw attributes: " << plainBytes / 1024 << " KB as float32, " << compactBytes / 1024 << " KB compressed ("
+         << double(plainBytes) / max<size_t>(1, compactBytes) << "x); derived series ("
+         << (compact.byteSize() - compactBytes) / 1024 << " KB) stay float32\n";
+    return allOk ? 0 : 1;
+}
+
+int runUpdateBenchmark(int corrections) {
+    vector<vector<string>> rows;
+    if (!readCSV(kDataPath, rows)) {
+        cerr << "Error opening file." << endl;
+        return 1;
+    }
+    AllData allData;
+    buildAllData(parseRecords(rows, false), allData);
+
+    //Every (county, attribute, year) of the file, to draw corrections from
+    struct Key { const string* path; const string* attribute; int year; float value; };
+    vector<Key> keys;
+    set<string> attributes;
+    int firstYear = INT32_MAX, lastYear = INT32_MIN;
+    for (const auto& pd : allData) {
+        for (const auto& sd : pd.second) {
+            attributes.insert(sd.first);
+            for (const auto& yv : sd.second) {
+                keys.push_back({&pd.first, &sd.first, yv.first, yv.second});
+                firstYear = min(firstYear, yv.first);
+                lastYear = max(lastYear, yv.first);
+            }
+        }
+    }
+    if (keys.empty()) return 1;
+
+    struct Correction { string path; string hashKey; Record r; };
+    auto correction = [](const Key& k, int year, float value) {
+        Correction c;
+        size_t slash = k.path->find('/');
+        int stateId = geography::stateIdFromName(string_view(*k.path).substr(0, slash));
+        c.path = *k.path;
+        c.r = Record{string(geography::kStates[stateId].abbrev), k.path->substr(slash + 1), *k.attribute, year, value};
+        c.hashKey = c.r.stateAbbrev + "," + c.r.county + "," + c.r.attribute + "," + to_string(year);
+        return c;
+    };
+
+    vector<int> sizes = corrections > 0 ? vector<int>{corrections} : vector<int>{100, 1000, 10000, 50000};
+    const int reps = 3;
+    cout << "\n=== Incremental updates (" << keys.size() << " values, best of " << reps << ") ===\n";
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%11s %8s %8s %12s %12s %9s %12s %6s\n", "corrections", "upserts", "removals",
+             "rebuild ms", "update ms", "speedup", "us/update", "check");
+    cout << buf;
+    bool allOk = true;
+    for (int n : sizes) {
+        //75% new value for an existing year, 15% removals, 10% a year past the end of the series
+        uint32_t seed = 12345u + static_cast<uint32_t>(n);
+        auto next = [&]{ seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+        vector<Correction> upserts, removals;
+        for (int i = 0; i < n; ++i) {
+            const Key& k = keys[next() % keys.size()];
+            uint32_t kind = next() % 100;
+            if (kind < 75) upserts.push_back(correction(k, k.year, k.value * 1.1f + 1.0f));
+            else if (kind < 90) removals.push_back(correction(k, k.year, 0.0f));
+            else upserts.push_back(correction(k, allData.at(*k.path).at(*k.attribute).rbegin()->first + 1, k.value));
+        }
+        vector<Record> upsertRecords, removalRecords;
+        for (const auto& c : upserts) upsertRecords.push_back(c.r);
+        for (const auto& c : removals) removalRecords.push_back(c.r);
+
+        //Rebuild: what a reload does for the tree and hash table today
+        double rebuildMs = 1e30;
+        AllData updated;
+        unique_ptr<Tree> rebuiltTree;
+        unique_ptr<hashTable> rebuiltHash;
+        for (int rep = 0; rep < reps; ++rep) {
+            updated = allData;
+            auto tree = make_unique<Tree>();
+            auto hash = make_unique<hashTable>();
+            auto tA = std::chrono::steady_clock::now();
+            applyRecords(updated, upsertRecords, removalRecords);
+            buildHashTable(updated, *hash);
+            buildTree(updated, *tree);
+            rebuildMs = min(rebuildMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tA).count());
+            rebuiltTree = std::move(tree);
+            rebuiltHash = std::move(hash);
+        }
+
+        //Incremental: the same corrections, in the same order, on the existing structures
+        double updateMs = 1e30;
+        unique_ptr<Tree> tree;
+        unique_ptr<hashTable> hash;
+        for (int rep = 0; rep < reps; ++rep) {
+            tree = make_unique<Tree>();
+            hash = make_unique<hashTable>();
+            buildHashTable(allData, *hash);
+            buildTree(allData, *tree);
+            auto tA = std::chrono::steady_clock::now();
+            for (const auto& c : upserts) {
+                tree->upsert(c.path, c.r.attribute, c.r.year, c.r.value);
+                hash->upsert(c.hashKey, to_string(c.r.value));
+            }
+            for (const auto& c : removals) {
+                tree->remove(c.path, c.r.attribute, c.r.year);
+                hash->remove(c.hashKey);
+            }
+            updateMs = min(updateMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tA).count());
+        }
+
+        //Both must agree on every value and every cached rollup
+        bool ok = tree->dataNodeCount() == rebuiltTree->dataNodeCount() && hash->size() == rebuiltHash->size();
+        for (const auto& pd : updated) {
+            for (const auto& sd : pd.second) {
+                for (const auto& yv : sd.second) {
+                    if (!ok) break;
+                    Correction c = correction(Key{&pd.first, &sd.first, yv.first, yv.second}, yv.first, yv.second);
+                    const string* v = hash->lookup(c.hashKey, hashTable::hash(c.hashKey));
+                    ok = v && *v == to_string(yv.second);
+                }
+            }
+        }
+        for (const auto* list : {&upserts, &removals}) {
+            for (const auto& c : *list) {
+                if (!ok) break;
+                string year = to_string(c.r.year);
+                ok = tree->searchValue(c.r.stateAbbrev, c.r.county, c.r.attribute, year) ==
+                     rebuiltTree->searchValue(c.r.stateAbbrev, c.r.county, c.r.attribute, year);
+            }
+        }
+        vector<string> geos = {"United States"};
+        for (auto region : geography::kRegions) geos.emplace_back(region);
+        for (const auto& state : geography::kStates) geos.emplace_back(state.name);
+        for (const string& geo : geos) {
+            for (const string& attr : attributes) {
+                for (int y = firstYear; ok && y <= lastYear + 1; ++y) {
+                    Tree::Rollup a = tree->aggregate(geo, attr, y), b = rebuiltTree->aggregate(geo, attr, y);
+                    ok = a.count == b.count && (a.count == 0 || (a.min == b.min && a.max == b.max &&
+                         fabs(a.sum - b.sum) <= 1e-7 * max(1.0, fabs(b.sum))));
+                }
+            }
+        }
+        allOk = allOk && ok;
+
+        snprintf(buf, sizeof(buf), "%11d %8zu %8zu %12.2f %12.3f %8.0fx %12.3f %6s\n", n, upserts.size(), removals.size(),
+                 rebuildMs, updateMs, rebuildMs / max(1e-6, updateMs), updateMs * 1000.0 / n, ok ? "OK" : "FAILED");
+        cout << buf;
+    }
+    return allOk ? 0 : 1;
+}
+
+LookupBenchmark benchmarkLookup(const hashTable& hashData, const Tree& tree, const string& state, const string& county,
+                                const string& attribute, int year, int warmRuns, int coldRuns, const function<bool()>& stop) {
+    LookupBenchmark result;
+    result.warmRuns = warmRuns;
+    result.coldRuns = coldRuns;
+    const string key = hashTable::makeKey(state, county, attribute, to_string(year));
+    result.hashProbes = hashData.probeCount(key, hashTable::hash(key));
+    //Both sides get their lookup key built up front: the hash its key string, the tree its state node
+    const Tree::StateRef stateRef = tree.stateRef(state);
+    float treeValue = tree.value(stateRef, county, attribute, year, &result.treeVisits);
+
+    //Results feed a volatile sink so the calls are not optimized away
+    volatile size_t sink = 0;
+    volatile float treeSink = 0.0f;
+    auto hashCall = [&]{ const string* v = hashData.lookup(key, hashTable::hash(key)); sink = sink + (v ? v->size() : 0); };
+    auto treeCall = [&]{ treeSink = tree.value(stateRef, county, attribute, year); };
+    result.found = hashData.lookup(key, hashTable::hash(key)) && !isnan(treeValue);
+
+    auto summarize = [](vector<double>& ns, double totalNs, size_t ops){
+        LookupBenchmark::Timing t;
+        if (ns.empty()) return t;
+        sort(ns.begin(), ns.end());
+        t.p50 = ns[ns.size() / 2];
+        t.p99 = ns[min(ns.size() - 1, static_cast<size_t>(0.99 * ns.size()))];
+        t.nsPerOp = totalNs / ops;
+        return t;
+    };
+    auto stopped = [&]{ return stop && stop(); };
+
+    //Every sample times a single call, so the percentiles are those of single lookups.
+    //Reading the clock twice costs about as much as a warm lookup; the median of
+    //back-to-back reads is that cost, taken off each sample.
+    vector<double> clockNs(10000);
+    for (double& c : clockNs) {
+        auto tA = std::chrono::steady_clock::now();
+        auto tB = std::chrono::steady_clock::now();
+        c = std::chrono::duration<double, std::nano>(tB - tA).count();
+    }
+    nth_element(clockNs.begin(), clockNs.begin() + clockNs.size() / 2, clockNs.end());
+    result.clockNs = clockNs[clockNs.size() / 2];
+    auto timeOne = [&](auto&& call){
+        auto tA = std::chrono::steady_clock::now();
+        call();
+        auto tB = std::chrono::steady_clock::now();
+        return max(0.0, std::chrono::duration<double, std::nano>(tB - tA).count() - result.clockNs);
+    };
+
+    auto warm = [&](auto&& call){
+        for (int i = 0; i < 1000; ++i) call();
+        vector<double> ns;
+        ns.reserve(warmRuns);
+        double total = 0.0;
+        for (int i = 0; i < warmRuns; ++i) {
+            if (i % 1024 == 0 && stopped()) break;
+            ns.push_back(timeOne(call));
+            total += ns.back();
+        }
+        return summarize(ns, total, max<size_t>(1, ns.size()));
+    };
+
+    //Sweeping 64 MB touches more lines than any desktop last-level cache holds
+    vector<uint8_t> evict(64 << 20, 1);
+    auto cold = [&](auto&& call){
+        vector<double> ns;
+        ns.reserve(coldRuns);
+        double total = 0.0;
+        for (int i = 0; i < coldRuns && !stopped(); ++i) {
+            size_t touch = 0;
+            for (size_t b = 0; b < evict.size(); b += 64) touch += evict[b]++;
+            sink = sink + touch;
+            ns.push_back(timeOne(call));
+            total += ns.back();
+        }
+        return summarize(ns, total, max<size_t>(1, ns.size()));
+    };
+
+    if (stopped()) return result;
+    result.hashWarm = warm(hashCall);
+    if (stopped()) return result;
+    result.treeWarm = warm(treeCall);
+    if (stopped()) return result;
+    result.hashCold = cold(hashCall);
+    if (stopped()) return result;
+    result.treeCold = cold(treeCall);
+    result.finished = !stopped();
+    return result;
+}
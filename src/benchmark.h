@@ -0,0 +1,68 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <functional>
+#include <string>
+
+class hashTable;
+class Tree;
+
+//Headless startup benchmark. Runs the whole startup path (CSV parse through
+//border mask) `runs` times and prints per-phase wall time, allocations and
+//peak RSS. If baselinePath exists the results are compared against it;
+//with saveBaseline the file is (re)written instead.
+//Returns 0, or 2 when a phase regressed against the baseline.
+int runStartupBenchmark(int runs, const std::string& baselinePath, bool saveBaseline);
+
+//Times every single hashTable::insert of the data file and prints latency
+//percentiles (p50 .. p99.9, max) for stop-the-world resizing, incremental
+//rehashing and a table pre-sized with reserve().
+int runHashInsertBenchmark();
+
+//Stress test and scaling run for shardedHashTable: parallel inserts with
+//concurrent locked readers, then lock-free lookups after freeze(), for
+//1, 2, 4 .. maxThreads threads. Every key is verified; returns 1 on a miss.
+int runShardedHashBenchmark(int maxThreads);
+
+//Correlation engine: all county x county Unemployment_rate trajectories of the
+//data file, then a synthetic set with 10x the counties (the matrix is reduced
+//to a histogram rather than stored), for 1, 2, 4 .. maxThreads threads. A
+//sample of pairs is checked against a scalar Pearson; returns 1 on a mismatch.
+int runCorrelationBenchmark(int maxThreads);
+
+//Compact series storage: per raw attribute the codec columnCodec picked, its
+//size against float32, and full-matrix scan and per-year state mean times
+//for both stores. Every decoded value is compared with the float32 store;
+//returns 1 on a mismatch.
+int runCodecBenchmark();
+
+//Batches of corrections (changed values, removals, new years) applied in place
+//with Tree::upsert/remove and hashTable::upsert/remove, against applying them
+//to allData and rebuilding both. The results are compared value by value and
+//rollup by rollup; returns 1 on a mismatch. corrections <= 0 runs several sizes.
+int runUpdateBenchmark(int corrections);
+
+//One (state, county, attribute, year) lookup repeated in the hash table (hash of
+//the prebuilt key + lookup) and in the tree (Tree::value from the state resolved
+//up front), so both time only their walk. Every run times one call, less the
+//measured cost of reading the clock. Warm runs follow warm-up calls; cold runs
+//evict the caches with a sweep over a buffer larger than the last-level cache
+//before each call.
+struct LookupBenchmark {
+    struct Timing {
+        double p50 = 0.0, p99 = 0.0, nsPerOp = 0.0;
+    };
+    Timing hashWarm, hashCold, treeWarm, treeCold;
+    int warmRuns = 0, coldRuns = 0;
+    int hashProbes = 0;     //bucket entries compared
+    int treeVisits = 0;     //nodes compared on the way down
+    double clockNs = 0.0;   //median cost of two clock reads, subtracted from every run
+    bool found = false;     //both structures hold the value
+    bool finished = false;  //false if stop() cut the run short
+};
+//county is the full name as in the data. stop is polled between phases and cold runs.
+LookupBenchmark benchmarkLookup(const hashTable& hashData, const Tree& tree, const std::string& state,
+                                const std::string& county, const std::string& attribute, int year,
+                                int warmRuns, int coldRuns, const std::function<bool()>& stop = nullptr);
+
+#endif //BENCHMARK_H
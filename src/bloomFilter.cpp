@@ -0,0 +1,89 @@
+#include <cmath>
+#include "bloomFilter.h"
+
+using namespace std;
+
+namespace {
+    //FNV-1a over the key fields, fed piece by piece without building the key string
+    struct KeyHasher {
+        uint64_t h = 1469598103934665603ULL;
+        void feed(string_view s) {
+            for (unsigned char c : s) {
+                h ^= c;
+                h *= 1099511628211ULL;
+            }
+        }
+        void sep() { feed(","); }
+        //Two independent hashes for double hashing (Kirsch-Mitzenmacher)
+        void finish(uint64_t& h1, uint64_t& h2) const {
+            uint64_t x = h;
+            x ^= x >> 33; x *= 0xff51afd7ed558ccdULL; x ^= x >> 33;
+            h1 = x;
+            x *= 0xc4ceb9fe1a85ec53ULL; x ^= x >> 33;
+            h2 = x | 1;
+        }
+    };
+}
+
+bloomFilter::bloomFilter(size_t expectedKeys, double targetFpr) {
+    reset(expectedKeys, targetFpr);
+}
+
+void bloomFilter::reset(size_t expectedKeys, double targetFpr) {
+    if (expectedKeys < 1) expectedKeys = 1;
+    if (targetFpr <= 0.0 || targetFpr >= 1.0) targetFpr = 0.01;
+    //m = -n ln p / (ln 2)^2, k = m/n ln 2
+    const double ln2 = log(2.0);
+    double m = -static_cast<double>(expectedKeys) * log(targetFpr) / (ln2 * ln2);
+    bitCount = max<size_t>(64, static_cast<size_t>(ceil(m / 64.0)) * 64);
+    hashCount = max(1, static_cast<int>(lround(bitCount / static_cast<double>(expectedKeys) * ln2)));
+    words.assign(bitCount / 64, 0);
+    keyCount = 0;
+    queries = 0;
+    rejected = 0;
+    falsePositives = 0;
+}
+
+void bloomFilter::add(string_view state, string_view county, string_view attribute, string_view year) {
+    KeyHasher k;
+    k.feed(state); k.sep(); k.feed(county); k.sep(); k.feed(attribute); k.sep(); k.feed(year);
+    uint64_t h1, h2;
+    k.finish(h1, h2);
+    for (int i = 0; i < hashCount; i++) {
+        uint64_t bit = (h1 + i * h2) % bitCount;
+        words[bit >> 6] |= 1ULL << (bit & 63);
+    }
+    keyCount++;
+}
+
+bool bloomFilter::mightContain(string_view state, string_view county, string_view attribute, string_view year) const {
+    KeyHasher k;
+    k.feed(state); k.sep(); k.feed(county); k.sep(); k.feed(attribute); k.sep(); k.feed(year);
+    uint64_t h1, h2;
+    k.finish(h1, h2);
+    queries.fetch_add(1, memory_order_relaxed);
+    if (test(h1, h2)) return true;
+    rejected.fetch_add(1, memory_order_relaxed);
+    return false;
+}
+
+bool bloomFilter::test(uint64_t h1, uint64_t h2) const {
+    for (int i = 0; i < hashCount; i++) {
+        uint64_t bit = (h1 + i * h2) % bitCount;
+        if (!(words[bit >> 6] & (1ULL << (bit & 63)))) return false;
+    }
+    return true;
+}
+
+bloomFilter::Stats bloomFilter::stats() const {
+    Stats s;
+    s.bits = bitCount;
+    s.hashes = hashCount;
+    s.keys = keyCount;
+    //(1 - e^(-kn/m))^k
+    s.expectedFpr = pow(1.0 - exp(-static_cast<double>(hashCount) * keyCount / bitCount), hashCount);
+    s.queries = queries.load(memory_order_relaxed);
+    s.rejected = rejected.load(memory_order_relaxed);
+    s.falsePositives = falsePositives.load(memory_order_relaxed);
+    return s;
+}
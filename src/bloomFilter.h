@@ -0,0 +1,56 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+//Bloom filter over (state, county, attribute, year) keys. A "no" answer means
+//the key is definitely in neither the hash table nor the tree, so the search
+//can skip building key strings and walking chains or children.
+class bloomFilter {
+public:
+    struct Stats {
+        size_t bits = 0;
+        int hashes = 0;
+        size_t keys = 0;
+        double expectedFpr = 0.0;     //from bits, hashes and keys
+        size_t queries = 0;
+        size_t rejected = 0;          //answered "definitely absent"
+        size_t falsePositives = 0;    //passed, but the lookup then missed
+        //False positives among all absent keys that were asked about
+        double observedFpr() const {
+            size_t absent = rejected + falsePositives;
+            return absent ? static_cast<double>(falsePositives) / absent : 0.0;
+        }
+    };
+
+    explicit bloomFilter(size_t expectedKeys = 1, double targetFpr = 0.01);
+    bloomFilter(const bloomFilter&) = delete;
+    bloomFilter& operator=(const bloomFilter&) = delete;
+
+    //Clear and resize for a new key set
+    void reset(size_t expectedKeys, double targetFpr = 0.01);
+
+    void add(std::string_view state, std::string_view county, std::string_view attribute, std::string_view year);
+    //county is the full name, as in hashTable::search
+    bool mightContain(std::string_view state, std::string_view county, std::string_view attribute, std::string_view year) const;
+    //Tell the filter a key it let through was not found after all
+    void reportFalsePositive() const { falsePositives.fetch_add(1, std::memory_order_relaxed); }
+
+    Stats stats() const;
+
+private:
+    std::vector<uint64_t> words;
+    size_t bitCount;
+    int hashCount;
+    size_t keyCount = 0;
+    mutable std::atomic<size_t> queries{0};
+    mutable std::atomic<size_t> rejected{0};
+    mutable std::atomic<size_t> falsePositives{0};
+
+    bool test(uint64_t h1, uint64_t h2) const;
+};
+
+#endif //BLOOMFILTER_H
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include "columnCodec.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CODEC_SSE2 1
+#endif
+
+using namespace std;
+
+namespace {
+    const uint8_t kMissing8 = 0xff;
+    const int16_t kMissing16 = INT16_MIN;
+    const double kMaxCode = 16777216.0;        //2^24: every code is exact in a float
+
+    int32_t toCode(float v, float divisor) {
+        return static_cast<int32_t>(llround(static_cast<double>(v) * divisor));
+    }
+
+    //Group varint: each value takes 1..4 little-endian bytes, and one control
+    //byte ahead of the row's data holds the 2-bit lengths of four values.
+    //Decoding reads a control byte and four unaligned words at offsets known
+    //up front, instead of testing every byte for a continuation bit.
+    struct GroupLayout {
+        uint8_t offset[256][4];
+        uint8_t size[256];
+        GroupLayout() {
+            for (int ctrl = 0; ctrl < 256; ++ctrl) {
+                int at = 0;
+                for (int k = 0; k < 4; ++k) {
+                    offset[ctrl][k] = static_cast<uint8_t>(at);
+                    at += ((ctrl >> (2 * k)) & 3) + 1;
+                }
+                size[ctrl] = static_cast<uint8_t>(at);
+            }
+        }
+    };
+    const GroupLayout kGroups;
+    const uint32_t kByteMasks[4] = {0xff, 0xffff, 0xffffff, 0xffffffff};
+
+    void putGroupVarints(vector<uint8_t>& out, const vector<uint32_t>& values) {
+        size_t ctrlAt = out.size();
+        out.resize(ctrlAt + (values.size() + 3) / 4, 0);
+        for (size_t i = 0; i < values.size(); ++i) {
+            uint32_t v = values[i];
+            int bytes = v < (1u << 8) ? 1 : v < (1u << 16) ? 2 : v < (1u << 24) ? 3 : 4;
+            out[ctrlAt + i / 4] |= static_cast<uint8_t>((bytes - 1) << (2 * (i % 4)));
+            for (int k = 0; k < bytes; ++k) out.push_back(static_cast<uint8_t>(v >> (8 * k)));
+        }
+    }
+
+    //One row of n group varints into v. Reads up to 3 bytes past the last
+    //value; encode() pads the buffer for that.
+    void readGroupVarints(const uint8_t* p, size_t n, uint32_t* v) {
+        const uint8_t* ctrl = p;
+        const uint8_t* data = p + (n + 3) / 4;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            uint8_t c = *ctrl++;
+            const uint8_t* off = kGroups.offset[c];
+            for (int k = 0; k < 4; ++k) {
+                uint32_t w;
+                memcpy(&w, data + off[k], 4);
+                v[i + k] = w & kByteMasks[(c >> (2 * k)) & 3];
+            }
+            data += kGroups.size[c];
+        }
+        for (int k = 0; i < n; ++i, ++k) {
+            uint32_t w;
+            memcpy(&w, data + kGroups.offset[*ctrl][k], 4);
+            v[i] = w & kByteMasks[(*ctrl >> (2 * k)) & 3];
+        }
+    }
+
+    //v is zigzag(delta) + 1, 0 for a missing value. ref += delta (reset to 0
+    //where missing); when out is set out = ref / divisor, NaN where missing.
+    void applyDeltas(int32_t* ref, const uint32_t* v, size_t n, float divisor, float* out) {
+        size_t i = 0;
+#ifdef CODEC_SSE2
+        const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi32(1);
+        const __m128 nan = _mm_set1_ps(NAN), div = _mm_set1_ps(divisor);
+        for (; i + 4 <= n; i += 4) {
+            __m128i z = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+            __m128i m = _mm_cmpeq_epi32(z, zero);
+            z = _mm_sub_epi32(z, one);
+            __m128i d = _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(zero, _mm_and_si128(z, one)));
+            __m128i r = _mm_andnot_si128(m, _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ref + i)), d));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(ref + i), r);
+            if (out) {
+                __m128 mf = _mm_castsi128_ps(m);
+                __m128 f = _mm_div_ps(_mm_cvtepi32_ps(r), div);
+                _mm_storeu_ps(out + i, _mm_or_ps(_mm_and_ps(mf, nan), _mm_andnot_ps(mf, f)));
+            }
+        }
+#endif
+        for (; i < n; ++i) {
+            bool m = v[i] == 0;
+            uint32_t z = v[i] - 1;
+            ref[i] = m ? 0 : ref[i] + (static_cast<int32_t>(z >> 1) ^ -static_cast<int32_t>(z & 1));
+            if (out) out[i] = m ? NAN : static_cast<float>(ref[i]) / divisor;
+        }
+    }
+
+    void decodeCode8(const uint8_t* p, size_t n, float* out) {
+        size_t i = 0;
+#ifdef CODEC_SSE2
+        const __m128i zero = _mm_setzero_si128(), missing = _mm_set1_epi32(kMissing8);
+        const __m128 nan = _mm_set1_ps(NAN);
+        for (; i + 16 <= n; i += 16) {
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            __m128i halves[2] = {_mm_unpacklo_epi8(b, zero), _mm_unpackhi_epi8(b, zero)};
+            for (int h = 0; h < 2; ++h) {
+                __m128i quads[2] = {_mm_unpacklo_epi16(halves[h], zero), _mm_unpackhi_epi16(halves[h], zero)};
+                for (int q = 0; q < 2; ++q) {
+                    __m128 m = _mm_castsi128_ps(_mm_cmpeq_epi32(quads[q], missing));
+                    __m128 v = _mm_cvtepi32_ps(quads[q]);
+                    _mm_storeu_ps(out + i + h * 8 + q * 4, _mm_or_ps(_mm_and_ps(m, nan), _mm_andnot_ps(m, v)));
+                }
+            }
+        }
+#endif
+        for (; i < n; ++i) out[i] = p[i] == kMissing8 ? NAN : static_cast<float>(p[i]);
+    }
+
+    void decodeFixed16(const uint8_t* p, size_t n, float divisor, float* out) {
+        size_t i = 0;
+#ifdef CODEC_SSE2
+        const __m128i missing = _mm_set1_epi32(kMissing16);
+        const __m128 nan = _mm_set1_ps(NAN), div = _mm_set1_ps(divisor);
+        for (; i + 8 <= n; i += 8) {
+            __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2 * i));
+            //Sign-extend each int16 by placing it in the high half and shifting back down
+            __m128i quads[2] = {_mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16), _mm_srai_epi32(_mm_unpackhi_epi16(w, w), 16)};
+            for (int q = 0; q < 2; ++q) {
+                __m128 m = _mm_castsi128_ps(_mm_cmpeq_epi32(quads[q], missing));
+                __m128 v = _mm_div_ps(_mm_cvtepi32_ps(quads[q]), div);
+                _mm_storeu_ps(out + i + q * 4, _mm_or_ps(_mm_and_ps(m, nan), _mm_andnot_ps(m, v)));
+            }
+        }
+#endif
+        for (; i < n; ++i) {
+            int16_t v;
+            memcpy(&v, p + 2 * i, 2);
+            out[i] = v == kMissing16 ? NAN : static_cast<float>(v) / divisor;
+        }
+    }
+}
+
+namespace columnCodec {
+
+    Column encode(const float* x, size_t rows, size_t len) {
+        Column c;
+        c.rows = rows;
+        c.len = len;
+        const size_t n = rows * len;
+
+        //Smallest power of ten that turns every value into an integer that
+        //converts back to exactly the same float
+        bool exact = false;
+        int32_t lo = INT32_MAX, hi = INT32_MIN;
+        for (float divisor : {1.0f, 10.0f, 100.0f, 1000.0f}) {
+            exact = true;
+            lo = INT32_MAX;
+            hi = INT32_MIN;
+            for (size_t i = 0; i < n && exact; ++i) {
+                if (isnan(x[i])) continue;
+                double scaled = static_cast<double>(x[i]) * divisor;
+                if (!(fabs(scaled) < kMaxCode)) {
+                    exact = false;
+                    break;
+                }
+                int32_t code = toCode(x[i], divisor);
+                exact = static_cast<float>(code) / divisor == x[i];
+                lo = min(lo, code);
+                hi = max(hi, code);
+            }
+            if (exact) {
+                c.divisor = divisor;
+                break;
+            }
+        }
+
+        if (!exact) {
+            c.codec = Codec::Float32;
+            c.bytes.resize(n * sizeof(float));
+            memcpy(c.bytes.data(), x, n * sizeof(float));
+        } else if (c.divisor == 1.0f && lo >= 0 && hi < kMissing8) {
+            c.codec = Codec::Code8;
+            c.bytes.resize(n);
+            for (size_t i = 0; i < n; ++i) c.bytes[i] = isnan(x[i]) ? kMissing8 : static_cast<uint8_t>(toCode(x[i], 1.0f));
+        } else if (lo > kMissing16 && hi <= INT16_MAX) {
+            c.codec = Codec::Fixed16;
+            c.bytes.resize(n * 2);
+            for (size_t i = 0; i < n; ++i) {
+                int16_t v = isnan(x[i]) ? kMissing16 : static_cast<int16_t>(toCode(x[i], c.divisor));
+                memcpy(c.bytes.data() + 2 * i, &v, 2);
+            }
+        } else {
+            //Change from the same county one row earlier; a missing earlier
+            //value and every keyframe row count from zero
+            c.codec = Codec::DeltaVarint;
+            c.bytes.reserve(n * 2);
+            vector<uint32_t> values(len);
+            for (size_t r = 0; r < rows; ++r) {
+                c.rowOffsets.push_back(static_cast<uint32_t>(c.bytes.size()));
+                const float* row = x + r * len;
+                for (size_t i = 0; i < len; ++i) {
+                    if (isnan(row[i])) {
+                        values[i] = 0;
+                        continue;
+                    }
+                    int32_t ref = (r % kKeyframeRows == 0 || isnan(row[i - len])) ? 0 : toCode(row[i - len], c.divisor);
+                    int32_t d = toCode(row[i], c.divisor) - ref;
+                    values[i] = ((static_cast<uint32_t>(d) << 1) ^ static_cast<uint32_t>(d >> 31)) + 1;
+                }
+                putGroupVarints(c.bytes, values);
+            }
+            c.bytes.resize(c.bytes.size() + 3);   //readGroupVarints loads whole words
+            c.bytes.shrink_to_fit();
+        }
+        return c;
+    }
+
+    void decodeRows(const Column& c, size_t row, size_t count, float* out) {
+        if (count == 0) return;
+        const size_t len = c.len;
+        switch (c.codec) {
+            case Codec::Float32:
+                memcpy(out, c.bytes.data() + row * len * sizeof(float), count * len * sizeof(float));
+                break;
+            case Codec::Code8:
+                decodeCode8(c.bytes.data() + row * len, count * len, out);
+                break;
+            case Codec::Fixed16:
+                decodeFixed16(c.bytes.data() + row * len * 2, count * len, c.divisor, out);
+                break;
+            case Codec::DeltaVarint: {
+                //Replay from the keyframe at or before row
+                thread_local vector<int32_t> ref;
+                thread_local vector<uint32_t> values;
+                ref.assign(len, 0);
+                values.resize(len);
+                for (size_t r = row - row % kKeyframeRows; r < row + count; ++r) {
+                    if (r % kKeyframeRows == 0) fill(ref.begin(), ref.end(), 0);
+                    readGroupVarints(c.bytes.data() + c.rowOffsets[r], len, values.data());
+                    applyDeltas(ref.data(), values.data(), len, c.divisor, r >= row ? out + (r - row) * len : nullptr);
+                }
+                break;
+            }
+        }
+    }
+
+    float decodeValue(const Column& c, size_t row, size_t i) {
+        if (row >= c.rows || i >= c.len) return NAN;
+        size_t k = row * c.len + i;
+        switch (c.codec) {
+            case Codec::Float32: {
+                float v;
+                memcpy(&v, c.bytes.data() + k * sizeof(float), sizeof(float));
+                return v;
+            }
+            case Codec::Code8:
+                return c.bytes[k] == kMissing8 ? NAN : static_cast<float>(c.bytes[k]);
+            case Codec::Fixed16: {
+                int16_t v;
+                memcpy(&v, c.bytes.data() + 2 * k, 2);
+                return v == kMissing16 ? NAN : static_cast<float>(v) / c.divisor;
+            }
+            case Codec::DeltaVarint: {
+                //Skip whole groups by their control bytes, then read value i of each row
+                int32_t ref = 0;
+                uint32_t v = 0;
+                for (size_t r = row - row % kKeyframeRows; r <= row; ++r) {
+                    const uint8_t* ctrl = c.bytes.data() + c.rowOffsets[r];
+                    const uint8_t* data = ctrl + (c.len + 3) / 4;
+                    for (size_t g = 0; g < i / 4; ++g) data += kGroups.size[ctrl[g]];
+                    uint8_t cb = ctrl[i / 4];
+                    uint32_t w;
+                    memcpy(&w, data + kGroups.offset[cb][i % 4], 4);
+                    v = w & kByteMasks[(cb >> (2 * (i % 4))) & 3];
+                    applyDeltas(&ref, &v, 1, c.divisor, nullptr);
+                }
+                return v == 0 ? NAN : static_cast<float>(ref) / c.divisor;
+            }
+        }
+        return NAN;
+    }
+
+    const char* codecName(Codec codec) {
+        switch (codec) {
+            case Codec::Float32:     return "float32";
+            case Codec::Code8:       return "code8";
+            case Codec::Fixed16:     return "fixed16";
+            case Codec::DeltaVarint: return "delta+varint";
+        }
+        return "?";
+    }
+}
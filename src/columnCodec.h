@@ -0,0 +1,44 @@
+#ifndef COLUMNCODEC_H
+#define COLUMNCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Compressed storage for a rows x len float matrix (one row per year, one
+//value per county). encode() picks the smallest codec that reproduces every
+//value exactly, so decoding is always lossless:
+//  Code8        small non-negative integers (codes, flags), one byte each
+//  Fixed16      fixed-point value * divisor in an int16 (rates like 5.3)
+//  DeltaVarint  fixed-point change from the previous row, zigzag group varint (counts)
+//  Float32      anything else, stored as is
+//Missing (NaN) values survive every codec. Decoding is SSE2 on x86.
+namespace columnCodec {
+
+    enum class Codec : uint8_t { Float32, Code8, Fixed16, DeltaVarint };
+
+    //DeltaVarint rows restart from zero every kKeyframeRows rows, so reading
+    //one row never decodes more than that many.
+    const size_t kKeyframeRows = 4;
+
+    struct Column {
+        Codec codec = Codec::Float32;
+        float divisor = 1.0f;               //value = code / divisor
+        size_t rows = 0;
+        size_t len = 0;
+        std::vector<uint8_t> bytes;
+        std::vector<uint32_t> rowOffsets;   //DeltaVarint: start of each row in bytes
+
+        size_t byteSize() const { return bytes.size() + rowOffsets.size() * sizeof(uint32_t); }
+    };
+
+    Column encode(const float* x, size_t rows, size_t len);
+
+    //Rows [row, row + count) into out, count * len floats.
+    void decodeRows(const Column& c, size_t row, size_t count, float* out);
+    float decodeValue(const Column& c, size_t row, size_t i);
+
+    const char* codecName(Codec codec);
+}
+
+#endif //COLUMNCODEC_H
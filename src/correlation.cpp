@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include "correlation.h"
+#include "trace.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CORRELATION_SSE2 1
+#endif
+
+using namespace std;
+
+namespace {
+    const size_t kTile = 64;
+
+    //out[k] = dot(a, b[k]) for four rows b[0..3]; n is a multiple of 4
+    void dot1x4(const float* a, const float* const* b, size_t n, float* out) {
+#ifdef CORRELATION_SSE2
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps(), acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+        for (size_t k = 0; k < n; k += 4) {
+            __m128 va = _mm_loadu_ps(a + k);
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(va, _mm_loadu_ps(b[0] + k)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(va, _mm_loadu_ps(b[1] + k)));
+            acc2 = _mm_add_ps(acc2, _mm_mul_ps(va, _mm_loadu_ps(b[2] + k)));
+            acc3 = _mm_add_ps(acc3, _mm_mul_ps(va, _mm_loadu_ps(b[3] + k)));
+        }
+        //Transpose-and-add so lane q of the result is the sum of acc q
+        _MM_TRANSPOSE4_PS(acc0, acc1, acc2, acc3);
+        _mm_storeu_ps(out, _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3)));
+#else
+        for (int q = 0; q < 4; ++q) {
+            float s = 0.0f;
+            for (size_t k = 0; k < n; ++k) s += a[k] * b[q][k];
+            out[q] = s;
+        }
+#endif
+    }
+
+    //Masked scalar Pearson for a pair where a row has gaps; a row without gaps
+    //is read back from its normalized values, which are a shifted and scaled
+    //copy and so give the same correlation
+    double gappedPair(const correlation::NormalizedRows& R, size_t i, size_t j) {
+        auto values = [&](size_t r) {
+            return R.gapped[r] >= 0 ? R.raw.data() + R.gapped[r] * R.len : R.data.data() + r * R.stride;
+        };
+        return correlation::pearson(values(i), values(j), R.len);
+    }
+
+    void computeTile(const correlation::NormalizedRows& R, size_t i0, size_t i1, size_t j0, size_t j1, float* r) {
+        size_t w = j1 - j0;
+        for (size_t i = i0; i < i1; ++i) {
+            const float* a = R.data.data() + i * R.stride;
+            float* row = r + (i - i0) * w;
+            size_t j = (i0 == j0) ? i : j0;    //diagonal tile: upper half only
+            for (; j + 4 <= j1; j += 4) {
+                const float* b[4];
+                for (int q = 0; q < 4; ++q) b[q] = R.data.data() + (j + q) * R.stride;
+                dot1x4(a, b, R.stride, row + (j - j0));
+            }
+            for (; j < j1; ++j) {
+                const float* b = R.data.data() + j * R.stride;
+                float s = 0.0f;
+                for (size_t k = 0; k < R.stride; ++k) s += a[k] * b[k];
+                row[j - j0] = s;
+            }
+            for (size_t jj = (i0 == j0) ? i : j0; jj < j1; ++jj) {
+                if (!R.valid[i] || !R.valid[jj]) row[jj - j0] = NAN;
+                else if (R.gapped[i] >= 0 || R.gapped[jj] >= 0) row[jj - j0] = static_cast<float>(gappedPair(R, i, jj));
+            }
+        }
+    }
+}
+
+namespace correlation {
+
+    NormalizedRows normalizeRows(const float* x, size_t rows, size_t len, size_t rowStep, size_t colStep) {
+        TRACE_SCOPE("correlation::normalizeRows");
+        NormalizedRows R;
+        R.rows = rows;
+        R.len = len;
+        R.stride = (len + 3) & ~size_t(3);
+        R.data.assign(rows * R.stride, 0.0f);
+        R.valid.assign(rows, 0);
+        R.gapped.assign(rows, -1);
+        for (size_t r = 0; r < rows; ++r) {
+            float* out = R.data.data() + r * R.stride;
+            double sum = 0.0;
+            size_t n = 0;
+            for (size_t k = 0; k < len; ++k) {
+                float v = x[r * rowStep + k * colStep];
+                if (isnan(v)) continue;
+                sum += v;
+                n++;
+            }
+            if (n < 2) continue;
+            if (n < len) {
+                R.gapped[r] = static_cast<int>(R.raw.size() / len);
+                for (size_t k = 0; k < len; ++k) R.raw.push_back(x[r * rowStep + k * colStep]);
+            }
+            double mean = sum / n, sq = 0.0;
+            for (size_t k = 0; k < len; ++k) {
+                float v = x[r * rowStep + k * colStep];
+                if (isnan(v)) continue;
+                out[k] = static_cast<float>(v - mean);
+                sq += static_cast<double>(out[k]) * out[k];
+            }
+            if (sq <= 0.0) {
+                fill(out, out + R.stride, 0.0f);
+                continue;
+            }
+            float inv = static_cast<float>(1.0 / sqrt(sq));
+            for (size_t k = 0; k < len; ++k) out[k] *= inv;
+            R.valid[r] = 1;
+        }
+        return R;
+    }
+
+    void pairwise(const NormalizedRows& rows, int threads, const function<void(const Tile&)>& sink) {
+        TRACE_SCOPE("correlation::pairwise");
+        size_t blocks = (rows.rows + kTile - 1) / kTile;
+        vector<pair<size_t, size_t>> tiles;   //(bi, bj) with bi <= bj
+        for (size_t bi = 0; bi < blocks; ++bi) {
+            for (size_t bj = bi; bj < blocks; ++bj) tiles.push_back({bi, bj});
+        }
+        atomic<size_t> next{0};
+        auto worker = [&]{
+            vector<float> buf(kTile * kTile);
+            for (size_t t = next++; t < tiles.size(); t = next++) {
+                Tile tile;
+                tile.i0 = tiles[t].first * kTile;  tile.i1 = min(rows.rows, tile.i0 + kTile);
+                tile.j0 = tiles[t].second * kTile; tile.j1 = min(rows.rows, tile.j0 + kTile);
+                computeTile(rows, tile.i0, tile.i1, tile.j0, tile.j1, buf.data());
+                tile.r = buf.data();
+                sink(tile);
+            }
+        };
+        if (threads < 1) threads = max(1u, thread::hardware_concurrency());
+        vector<thread> pool;
+        for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (auto& th : pool) th.join();
+    }
+
+    vector<float> matrix(const NormalizedRows& rows, int threads) {
+        size_t n = rows.rows;
+        vector<float> m(n * n);
+        pairwise(rows, threads, [&](const Tile& t){
+            size_t w = t.j1 - t.j0;
+            for (size_t i = t.i0; i < t.i1; ++i) {
+                for (size_t j = (t.i0 == t.j0) ? i : t.j0; j < t.j1; ++j) {
+                    float r = t.r[(i - t.i0) * w + (j - t.j0)];
+                    m[i * n + j] = r;
+                    m[j * n + i] = r;
+                }
+            }
+        });
+        return m;
+    }
+
+    double pearson(const float* a, const float* b, size_t n) {
+        double sa = 0.0, sb = 0.0;
+        size_t cnt = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (isnan(a[i]) || isnan(b[i])) continue;
+            sa += a[i];
+            sb += b[i];
+            cnt++;
+        }
+        if (cnt < 2) return NAN;
+        double ma = sa / cnt, mb = sb / cnt, sab = 0.0, saa = 0.0, sbb = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            if (isnan(a[i]) || isnan(b[i])) continue;
+            double da = a[i] - ma, db = b[i] - mb;
+            sab += da * db;
+            saa += da * da;
+            sbb += db * db;
+        }
+        if (saa <= 0.0 || sbb <= 0.0) return NAN;
+        return sab / sqrt(saa * sbb);
+    }
+
+    vector<float> attributeMatrix(const seriesStore& store, const vector<string>& attributes, int threads) {
+        TRACE_SCOPE("correlation::attributeMatrix");
+        //Each attribute decoded once into a row over every (year, county) cell;
+        //unknown attributes stay all NaN and so come out invalid
+        size_t n = attributes.size(), cells = static_cast<size_t>(store.lastYear() - store.firstYear() + 1) * store.countyCount();
+        vector<float> rows(n * cells, NAN), scratch;
+        for (size_t i = 0; i < n; ++i) {
+            span<const float> a = store.matrix(attributes[i], scratch);
+            if (a.size() == cells) copy(a.begin(), a.end(), rows.begin() + i * cells);
+        }
+        //Attributes cover different years and counties, so most rows take the masked path
+        return matrix(normalizeRows(rows.data(), n, cells, cells, 1), threads);
+    }
+
+    bool writeCSV(const string& path, const vector<string>& labels, const vector<float>& m) {
+        ofstream out(path);
+        if (!out) return false;
+        size_t n = labels.size();
+        for (size_t j = 0; j < n; ++j) out << "," << '"' << labels[j] << '"';
+        out << "\n";
+        char buf[32];
+        for (size_t i = 0; i < n; ++i) {
+            out << '"' << labels[i] << '"';
+            for (size_t j = 0; j < n; ++j) {
+                float r = m[i * n + j];
+                if (isnan(r)) out << ",";
+                else { snprintf(buf, sizeof(buf), ",%.4f", r); out << buf; }
+            }
+            out << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+} // namespace correlation
@@ -0,0 +1,58 @@
+#ifndef CORRELATION_H
+#define CORRELATION_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "seriesStore.h"
+
+//Pearson correlation between series. Rows (e.g. counties' trajectories) are
+//first normalized so that the correlation of two gap-free rows is a plain dot product;
+//the row x row matrix is then computed tile by tile (64 x 64 rows, fits in L1)
+//with an SSE2 micro-kernel, tiles spread over worker threads.
+namespace correlation {
+
+    //Row-major, each row centered on its mean and scaled to unit length.
+    //Rows with fewer than two values or no variance are invalid. A row with
+    //missing (NaN) entries also keeps its raw values: its pairs are computed by
+    //pearson() over the years both rows have, since its own mean and length
+    //are not those of the shared years.
+    struct NormalizedRows {
+        size_t rows = 0;
+        size_t len = 0;       //values per row
+        size_t stride = 0;    //len rounded up to 4
+        std::vector<float> data;
+        std::vector<char> valid;
+        std::vector<int> gapped;   //per row, its index into raw; -1 if it has no gaps
+        std::vector<float> raw;    //len values per gapped row, NaN where missing
+    };
+
+    //Element (r, k) is x[r * rowStep + k * colStep].
+    NormalizedRows normalizeRows(const float* x, size_t rows, size_t len, size_t rowStep, size_t colStep);
+
+    //One tile of the upper triangle: r[(i - i0) * (j1 - j0) + (j - j0)] is the
+    //correlation of rows i and j (NaN if either is invalid). On diagonal tiles
+    //only j >= i is filled.
+    struct Tile {
+        size_t i0, i1, j0, j1;
+        const float* r;
+    };
+    //Calls sink once per tile, concurrently from up to `threads` threads.
+    void pairwise(const NormalizedRows& rows, int threads, const std::function<void(const Tile&)>& sink);
+
+    //Full symmetric rows x rows matrix
+    std::vector<float> matrix(const NormalizedRows& rows, int threads);
+
+    //Correlation over the positions where both a and b have a value.
+    double pearson(const float* a, const float* b, size_t n);
+
+    //Attribute x attribute matrix over every (county, year) cell of the store,
+    //one normalized row per attribute through the tiled kernel.
+    std::vector<float> attributeMatrix(const seriesStore& store, const std::vector<std::string>& attributes, int threads = 0);
+
+    //Square matrix as CSV with labels as the header row and first column.
+    bool writeCSV(const std::string& path, const std::vector<std::string>& labels, const std::vector<float>& m);
+}
+
+#endif //CORRELATION_H
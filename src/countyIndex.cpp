@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cctype>
+#include "countyIndex.h"
+#include "geography.h"
+#include "memoryStats.h"
+#include "trace.h"
+
+using namespace std;
+
+void countyIndex::build(const AllData& allData) {
+    TRACE_SCOPE("countyIndex::build");
+    memoryStats::Scope mem(memoryStats::Subsystem::Indexes);
+    vector<pair<string, County>> sorted;
+    for (const auto& pd : allData) {
+        size_t slash = pd.first.find('/');
+        int stateId = geography::stateIdFromName(string_view(pd.first).substr(0, slash));
+        if (stateId < 0) continue;
+        string name = pd.first.substr(slash + 1);
+        string key = name;
+        for (char& c : key) c = (char)tolower((unsigned char)c);
+        sorted.push_back({std::move(key), County{stateId, std::move(name)}});
+    }
+    sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b){
+        if (a.second.stateId != b.second.stateId) return a.second.stateId < b.second.stateId;
+        return a.first < b.first;
+    });
+    list.clear();
+    keys.clear();
+    list.reserve(sorted.size());
+    keys.reserve(sorted.size());
+    for (auto& kc : sorted) {
+        keys.push_back(std::move(kc.first));
+        list.push_back(std::move(kc.second));
+    }
+
+    stateBegin.assign(geography::kStateCount + 1, 0);
+    for (const auto& c : list) stateBegin[c.stateId + 1]++;
+    for (int s = 0; s < geography::kStateCount; s++) stateBegin[s + 1] += stateBegin[s];
+}
+
+bool countyIndex::lower(string_view s, char* buf, size_t cap, size_t& len) {
+    if (s.size() > cap) return false;
+    for (size_t i = 0; i < s.size(); i++) buf[i] = (char)tolower((unsigned char)s[i]);
+    len = s.size();
+    return true;
+}
+
+size_t countyIndex::suggest(int stateId, string_view prefix, int* out, size_t maxResults) const {
+    if (stateId < 0 || stateId >= geography::kStateCount || stateBegin.empty()) return 0;
+    char buf[128];
+    size_t len;
+    if (!lower(prefix, buf, sizeof(buf), len)) return 0;
+    string_view p(buf, len);
+
+    auto first = keys.begin() + stateBegin[stateId];
+    auto last = keys.begin() + stateBegin[stateId + 1];
+    auto it = lower_bound(first, last, p, [](const string& k, string_view v){ return string_view(k) < v; });
+    size_t n = 0;
+    for (; it != last && n < maxResults; ++it) {
+        if (string_view(*it).substr(0, p.size()) != p) break;
+        out[n++] = static_cast<int>(it - keys.begin());
+    }
+    return n;
+}
+
+int countyIndex::resolve(int stateId, string_view input) const {
+    if (stateId < 0 || stateId >= geography::kStateCount || stateBegin.empty()) return -1;
+    char buf[128];
+    size_t len;
+    if (!lower(input, buf, sizeof(buf) - 7, len)) return -1;
+
+    auto first = keys.begin() + stateBegin[stateId];
+    auto last = keys.begin() + stateBegin[stateId + 1];
+    auto find = [&](string_view key)->int{
+        auto it = lower_bound(first, last, key, [](const string& k, string_view v){ return string_view(k) < v; });
+        return (it != last && *it == key) ? static_cast<int>(it - keys.begin()) : -1;
+    };
+    int id = find(string_view(buf, len));
+    if (id >= 0) return id;
+    //"Alachua" -> "alachua county"
+    const char suffix[] = " county";
+    copy(suffix, suffix + 7, buf + len);
+    return find(string_view(buf, len + 7));
+}
+
+pair<int, int> countyIndex::stateCounties(int stateId) const {
+    if (stateId < 0 || stateId >= geography::kStateCount || stateBegin.empty()) return {0, 0};
+    return {stateBegin[stateId], stateBegin[stateId + 1]};
+}
@@ -0,0 +1,44 @@
+#ifndef COUNTYINDEX_H
+#define COUNTYINDEX_H
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "dataLoader.h"
+
+//Sorted county names per state for type-ahead and exact matching.
+//Lookups are binary searches over lower-cased names and never allocate.
+class countyIndex {
+public:
+    struct County {
+        int stateId;        //geography state id
+        std::string name;   //as in the data, e.g. "Alachua County"
+    };
+
+    void build(const AllData& allData);
+
+    //All counties; a county's id is its position. Sorted by state, then name.
+    const std::vector<County>& counties() const { return list; }
+
+    //Writes up to maxResults ids of counties in stateId whose name starts with
+    //prefix (case-insensitive) to out and returns how many were written.
+    size_t suggest(int stateId, std::string_view prefix, int* out, size_t maxResults) const;
+
+    //Case-insensitive exact match on the name, or on the name without its
+    //" County" suffix. -1 if there is none.
+    int resolve(int stateId, std::string_view input) const;
+
+    //Ids of the counties of stateId are [first, second); empty for an unknown state.
+    std::pair<int, int> stateCounties(int stateId) const;
+
+private:
+    std::vector<County> list;
+    std::vector<std::string> keys;    //lower-cased names, same order as list
+    std::vector<int> stateBegin;      //counties of state s are [stateBegin[s], stateBegin[s+1])
+
+    //Lower-cases s into buf; returns false if it does not fit
+    static bool lower(std::string_view s, char* buf, size_t cap, size_t& len);
+};
+
+#endif //COUNTYINDEX_H
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include "dataExport.h"
+#include "geography.h"
+
+using namespace std;
+
+static_assert(endian::native == endian::little, "the .evc layout is written in host byte order");
+
+namespace dataExport {
+
+    bool OutFile::open(const string& path) {
+        close();
+        file = fopen(path.c_str(), "wb");
+        buffer.resize(kBufferBytes);
+        used = total = 0;
+        failed = file == nullptr;
+        return file != nullptr;
+    }
+
+    bool OutFile::close() {
+        if (!file) return !failed;
+        flush();
+        if (fclose(file) != 0) failed = true;
+        file = nullptr;
+        return !failed;
+    }
+
+    void OutFile::flush() {
+        if (used && file && fwrite(buffer.data(), 1, used, file) != used) failed = true;
+        total += used;
+        used = 0;
+    }
+
+    void OutFile::write(const void* data, size_t n) {
+        const char* p = static_cast<const char*>(data);
+        while (n > 0) {
+            if (used == buffer.size()) flush();
+            size_t chunk = min(n, buffer.size() - used);
+            memcpy(buffer.data() + used, p, chunk);
+            used += chunk;
+            p += chunk;
+            n -= chunk;
+        }
+    }
+
+    //Formats straight into the buffer; 32 bytes hold any int64, float or double
+    template <typename T>
+    static void appendNumber(OutFile& out, T v) {
+        char tmp[32];
+        auto r = to_chars(tmp, tmp + sizeof(tmp), v);
+        out.write(tmp, r.ptr - tmp);
+    }
+    void OutFile::number(int64_t v) { appendNumber(*this, v); }
+    void OutFile::number(float v) { appendNumber(*this, v); }
+    void OutFile::number(double v) { appendNumber(*this, v); }
+
+    void ColumnFile::addColumn(string name, Type type, vector<string> dictionary) {
+        columns.push_back({move(name), type, move(dictionary)});
+    }
+
+    bool ColumnFile::open(const string& path) {
+        values.assign(columns.size(), vector<Value>(kGroupRows));
+        rows = 0;
+        totalRows = 0;
+        if (!out.open(path)) return false;
+        out.write("EVCOL1\n\0", 8);
+        uint32_t n = static_cast<uint32_t>(columns.size());
+        out.write(&n, sizeof(n));
+        for (const Column& c : columns) {
+            uint8_t type = static_cast<uint8_t>(c.type);
+            uint16_t len = static_cast<uint16_t>(c.name.size());
+            out.write(&type, 1);
+            out.write(&len, sizeof(len));
+            out.text(c.name);
+            if (c.type != Type::Code16) continue;
+            uint32_t entries = static_cast<uint32_t>(c.dictionary.size());
+            out.write(&entries, sizeof(entries));
+            for (const string& e : c.dictionary) {
+                len = static_cast<uint16_t>(e.size());
+                out.write(&len, sizeof(len));
+                out.text(e);
+            }
+        }
+        return true;
+    }
+
+    void ColumnFile::flushGroup() {
+        if (rows == 0) return;
+        uint32_t n = static_cast<uint32_t>(rows);
+        out.write(&n, sizeof(n));
+        for (size_t c = 0; c < columns.size(); ++c) {
+            const Value* v = values[c].data();
+            switch (columns[c].type) {
+            case Type::Code16:
+            case Type::Int16:
+                for (size_t r = 0; r < rows; ++r) { int16_t x = static_cast<int16_t>(v[r].i); out.write(&x, sizeof(x)); }
+                break;
+            case Type::Int32:
+                for (size_t r = 0; r < rows; ++r) { int32_t x = static_cast<int32_t>(v[r].i); out.write(&x, sizeof(x)); }
+                break;
+            case Type::Float32:
+                for (size_t r = 0; r < rows; ++r) { float x = static_cast<float>(v[r].f); out.write(&x, sizeof(x)); }
+                break;
+            case Type::Float64:
+                for (size_t r = 0; r < rows; ++r) out.write(&v[r].f, sizeof(double));
+                break;
+            }
+        }
+        totalRows += rows;
+        rows = 0;
+    }
+
+    bool ColumnFile::close() {
+        flushGroup();
+        uint32_t end = 0;
+        out.write(&end, sizeof(end));
+        out.write(&totalRows, sizeof(totalRows));
+        values.clear();
+        return out.close();
+    }
+
+    namespace {
+        string csvEscaped(const string& s) {
+            if (s.find_first_of(",\"\r\n") == string::npos) return s;
+            string out = "\"";
+            for (char c : s) {
+                if (c == '"') out += '"';
+                out += c;
+            }
+            return out + '"';
+        }
+
+        //One table written to a .csv and/or a .evc at the same time. Code columns
+        //take an index into their dictionary; the CSV gets the entry pre-escaped.
+        class Table {
+        public:
+            struct Field {
+                string name;
+                ColumnFile::Type type;
+                vector<string> dictionary;
+            };
+
+            Table(const string& dir, const string& name, vector<Field> fieldList, bool csv, bool columnar)
+                : name(name), fields(move(fieldList)), csvOn(csv), columnarOn(columnar) {
+                for (Field& f : fields) {
+                    escaped.emplace_back();
+                    for (const string& e : f.dictionary) escaped.back().push_back(csvEscaped(e));
+                    if (columnarOn) col.addColumn(f.name, f.type, move(f.dictionary));
+                }
+                csvPath = dir + "/" + name + ".csv";
+                columnarPath = dir + "/" + name + ".evc";
+                if (csvOn && csvFile.open(csvPath)) {
+                    for (size_t i = 0; i < fields.size(); ++i) {
+                        if (i) csvFile.put(',');
+                        csvFile.text(fields[i].name);
+                    }
+                    csvFile.put('\n');
+                }
+                if (columnarOn) col.open(columnarPath);
+                start = chrono::steady_clock::now();
+            }
+
+            void code(size_t c, size_t index) {
+                if (csvOn) { separator(c); csvFile.text(escaped[c][index]); }
+                if (columnarOn) col.putInt(c, static_cast<int64_t>(index));
+            }
+            void integer(size_t c, int64_t v) {
+                if (csvOn) { separator(c); csvFile.number(v); }
+                if (columnarOn) col.putInt(c, v);
+            }
+            void real(size_t c, double v) {
+                if (csvOn) {
+                    separator(c);
+                    if (fields[c].type == ColumnFile::Type::Float32) csvFile.number(static_cast<float>(v));
+                    else csvFile.number(v);
+                }
+                if (columnarOn) col.putReal(c, v);
+            }
+            void endRow() {
+                if (csvOn) csvFile.put('\n');
+                if (columnarOn) col.endRow();
+                ++rows;
+            }
+
+            //Closes the files and prints what was written; false if a write failed
+            bool finish() {
+                bool ok = true;
+                size_t bytes = 0;
+                if (csvOn) {
+                    bytes += csvFile.bytesWritten();
+                    if (!csvFile.close()) { cerr << "Could not write " << csvPath << endl; ok = false; }
+                }
+                if (columnarOn) {
+                    bytes += col.bytesWritten();
+                    if (!col.close()) { cerr << "Could not write " << columnarPath << endl; ok = false; }
+                }
+                double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                cout << name << ": " << rows << " rows, " << bytes / 1024 << " KB";
+                if (csvOn && columnarOn) cout << " (csv " << csvFile.bytesWritten() / 1024 << " KB, evc " << col.bytesWritten() / 1024 << " KB)";
+                cout << ", " << ms << " ms, " << (ms > 0 ? bytes / 1048576.0 / (ms / 1000.0) : 0.0) << " MB/s" << endl;
+                return ok;
+            }
+
+        private:
+            void separator(size_t c) { if (c) csvFile.put(','); }
+
+            string name, csvPath, columnarPath;
+            vector<Field> fields;
+            vector<vector<string>> escaped;   //per column, CSV text of each dictionary entry
+            bool csvOn, columnarOn;
+            OutFile csvFile;
+            ColumnFile col;
+            size_t rows = 0;
+            chrono::steady_clock::time_point start;
+        };
+
+        vector<string> stateAbbrevs() {
+            vector<string> out;
+            for (const auto& s : geography::kStates) out.emplace_back(s.abbrev);
+            return out;
+        }
+
+        //Raw attributes only: derived series have no tree rollups
+        vector<string> rawAttributes(const Dataset& d) {
+            vector<string> out;
+            const vector<string>& derived = d.series.derivedAttributes();
+            for (const string& a : d.series.attributes())
+                if (find(derived.begin(), derived.end(), a) == derived.end()) out.push_back(a);
+            return out;
+        }
+    }
+
+    int exportData(const Dataset& d, const string& dir, bool csv, bool columnar) {
+        error_code ec;
+        filesystem::create_directories(dir, ec);
+        if (ec) { cerr << "Cannot create " << dir << ": " << ec.message() << endl; return 1; }
+        bool ok = true;
+        using Type = ColumnFile::Type;
+
+        //County series: one row per county, attribute and year with a value, read a year column at a time
+        {
+            const vector<countyIndex::County>& counties = d.counties.counties();
+            vector<string> countyNames;
+            countyNames.reserve(counties.size());
+            for (const auto& c : counties) countyNames.push_back(c.name);
+            vector<string> attributes = d.series.attributes();
+            Table t(dir, "county_series", {{"state", Type::Code16, stateAbbrevs()},
+                                           {"county", Type::Code16, move(countyNames)},
+                                           {"attribute", Type::Code16, attributes},
+                                           {"year", Type::Int16, {}},
+                                           {"value", Type::Float32, {}}}, csv, columnar);
+            vector<float> scratch;
+            for (size_t a = 0; a < attributes.size(); ++a) {
+                for (int year = d.series.firstYear(); year <= d.series.lastYear(); ++year) {
+                    span<const float> column = d.series.column(attributes[a], year, scratch);
+                    for (size_t i = 0; i < column.size(); ++i) {
+                        if (isnan(column[i])) continue;
+                        t.code(0, counties[i].stateId);
+                        t.code(1, i);
+                        t.code(2, a);
+                        t.integer(3, year);
+                        t.real(4, column[i]);
+                        t.endRow();
+                    }
+                }
+            }
+            ok &= t.finish();
+        }
+
+        //State aggregates: the tree's cached rollups for the nation, the regions and the states
+        {
+            vector<string> geos = {"United States"};
+            for (auto r : geography::kRegions) geos.emplace_back(r);
+            for (const auto& s : geography::kStates) geos.emplace_back(s.name);
+            vector<string> attributes = rawAttributes(d);
+            Table t(dir, "state_aggregates", {{"geo", Type::Code16, geos},
+                                              {"attribute", Type::Code16, attributes},
+                                              {"year", Type::Int16, {}},
+                                              {"count", Type::Int32, {}},
+                                              {"sum", Type::Float64, {}},
+                                              {"mean", Type::Float32, {}},
+                                              {"min", Type::Float32, {}},
+                                              {"max", Type::Float32, {}}}, csv, columnar);
+            for (size_t g = 0; g < geos.size(); ++g) {
+                for (size_t a = 0; a < attributes.size(); ++a) {
+                    for (int year = d.series.firstYear(); year <= d.series.lastYear(); ++year) {
+                        Tree::Rollup r = d.tree.aggregate(geos[g], attributes[a], year);
+                        if (r.count == 0) continue;
+                        t.code(0, g);
+                        t.code(1, a);
+                        t.integer(2, year);
+                        t.integer(3, r.count);
+                        t.real(4, r.sum);
+                        t.real(5, r.mean());
+                        t.real(6, r.min);
+                        t.real(7, r.max);
+                        t.endRow();
+                    }
+                }
+            }
+            ok &= t.finish();
+        }
+
+        //NEED scores per state
+        {
+            Table t(dir, "need_scores", {{"state", Type::Code16, stateAbbrevs()},
+                                         {"need", Type::Float32, {}}}, csv, columnar);
+            for (size_t s = 0; s < d.stateData.size(); ++s) {
+                if (isnan(d.stateData[s])) continue;
+                t.code(0, s);
+                t.real(1, d.stateData[s]);
+                t.endRow();
+            }
+            ok &= t.finish();
+        }
+        return ok ? 0 : 1;
+    }
+}
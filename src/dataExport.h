@@ -0,0 +1,96 @@
+#ifndef DATAEXPORT_H
+#define DATAEXPORT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "dataset.h"
+
+//Streaming output of county series, state aggregates and NEED scores for
+//downstream tools, as CSV and as a compact columnar binary (.evc). Rows go
+//straight from the stores into fixed buffers, so memory stays bounded and no
+//string is built per row.
+namespace dataExport {
+
+    //Output file behind one fixed buffer, written with fwrite when it fills up
+    class OutFile {
+    public:
+        static const size_t kBufferBytes = 1 << 20;
+
+        OutFile() = default;
+        OutFile(const OutFile&) = delete;
+        OutFile& operator=(const OutFile&) = delete;
+        ~OutFile() { close(); }
+
+        bool open(const std::string& path);
+        //False if any write failed
+        bool close();
+
+        void write(const void* data, size_t n);
+        void text(std::string_view s) { write(s.data(), s.size()); }
+        void put(char c) {
+            if (used == buffer.size()) flush();
+            buffer[used++] = c;
+        }
+        //Shortest text that reads back to the same value
+        void number(int64_t v);
+        void number(float v);
+        void number(double v);
+        size_t bytesWritten() const { return total + used; }
+
+    private:
+        void flush();
+        FILE* file = nullptr;
+        std::vector<char> buffer;
+        size_t used = 0;
+        size_t total = 0;
+        bool failed = false;
+    };
+
+    //Columnar table file, written in groups of kGroupRows rows so only one group is
+    //held in memory. Layout, little endian:
+    //  "EVCOL1\n\0"
+    //  u32 columns, then per column: u8 type, u16 name length, name,
+    //      and for Code16 a dictionary: u32 entries, each u16 length + bytes
+    //  row groups: u32 rows, then each column's values for those rows back to back
+    //      (Code16 u16 index into the dictionary, Int16 i16, Int32 i32, Float32/Float64 IEEE)
+    //  u32 0, u64 total rows
+    class ColumnFile {
+    public:
+        enum class Type : uint8_t { Code16 = 1, Int16 = 2, Int32 = 3, Float32 = 4, Float64 = 5 };
+        static const size_t kGroupRows = 1 << 16;
+
+        void addColumn(std::string name, Type type, std::vector<std::string> dictionary = {});
+        bool open(const std::string& path);   //writes the header; columns are fixed from here on
+        void putInt(size_t column, int64_t v) { values[column][rows].i = v; }   //Code16 takes the dictionary index
+        void putReal(size_t column, double v) { values[column][rows].f = v; }
+        void endRow() {
+            if (++rows == kGroupRows) flushGroup();
+        }
+        bool close();
+        size_t bytesWritten() const { return out.bytesWritten(); }
+
+    private:
+        union Value { int64_t i; double f; };
+        struct Column {
+            std::string name;
+            Type type;
+            std::vector<std::string> dictionary;
+        };
+        void flushGroup();
+
+        std::vector<Column> columns;
+        std::vector<std::vector<Value>> values;   //current group, per column
+        size_t rows = 0;
+        uint64_t totalRows = 0;
+        OutFile out;
+    };
+
+    //Writes county_series, state_aggregates and need_scores (.csv and/or .evc) into dir
+    //and prints rows, bytes and MB/s per file. Returns 1 if a file could not be written.
+    int exportData(const Dataset& d, const std::string& dir, bool csv, bool columnar);
+}
+
+#endif //DATAEXPORT_H
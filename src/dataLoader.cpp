@@ -0,0 +1,294 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+#include <cmath>
+#include <charconv>
+#include <memory>
+#include "dataLoader.h"
+#include "trace.h"
+#include "memoryStats.h"
+#include "geography.h"
+
+using namespace std;
+
+//Records only hold abbreviations that passed parseRecords, so the lookup cannot fail
+static string fullStateName(const string& abbrev) {
+    return string(geography::kStates[geography::stateIdFromAbbrev(abbrev)].name);
+}
+
+bool readCSV(const string& path, vector<vector<string>>& rows) {
+    TRACE_SCOPE("readCSV");
+    memoryStats::Scope mem(memoryStats::Subsystem::Loader);
+    ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    string line;
+    while (getline(file, line)) {
+        vector<string> row;
+        splitCSVLine(line, row);
+        if (!row.empty()){
+            rows.push_back(row);
+        }
+    }
+    file.close();
+    return true;
+}
+
+void splitCSVLine(const string& line, vector<string>& row) {
+    stringstream ss(line);
+    string cell;
+    while (getline(ss, cell, ',')) {
+        //Strip quotes if present
+        if (!cell.empty() && cell.front() == '"' && cell.back() == '"') {
+            cell = cell.substr(1, cell.size() - 2);
+        }
+        row.push_back(cell);
+    }
+}
+
+vector<Record> parseRecords(const vector<vector<string>>& rows, bool verbose) {
+    shared_ptr<const Schema> schema = Schema::builtin();
+    return parseRecords(*schema, schema->files[0], rows, verbose);
+}
+
+vector<Record> parseRecords(const Schema& schema, const Schema::File& file, const vector<vector<string>>& rows, bool verbose) {
+    TRACE_SCOPE("parseRecords");
+    memoryStats::Scope mem(memoryStats::Subsystem::Loader);
+    vector<Record> records;
+    records.reserve(file.wide ? rows.size() * file.columns.size() : rows.size());
+
+    //Rows of a long file come grouped by attribute, so its name is resolved once per run of rows
+    string lastRaw, lastName;
+    Schema::Type lastType = Schema::Type::Float;
+
+    //Row 0 is the header
+    for (size_t i = 1; i < rows.size(); ++i) {
+        const auto& row = rows[i];
+        if (row.size() < file.minColumns || row[file.state].empty()){
+            if (verbose) cout << "Skipping invalid row " << i << endl;
+            continue;
+        }
+
+        const string& stateAbbrev = row[file.state];
+        if (geography::stateIdFromAbbrev(stateAbbrev) < 0){
+            if (verbose) cout << "Unknown state abbreviation in row " << i << endl;
+            continue;
+        }
+        const string& county = row[file.county];
+
+        if (file.wide) {
+            int year = file.year;
+            if (file.yearColumn >= 0) {
+                float y;
+                if (!parseTyped(row[file.yearColumn], Schema::Type::Int, y)) {
+                    if (verbose) cout << "Invalid year in row " << i << endl;
+                    continue;
+                }
+                year = static_cast<int>(y);
+            }
+            //Empty cells are missing values; anything else must match the column type
+            for (size_t c = 0; c < file.columns.size() && c < row.size(); ++c) {
+                const Schema::Column& col = file.columns[c];
+                if (col.role != Schema::Role::Attribute || row[c].empty()) continue;
+                float value;
+                if (!parseTyped(row[c], col.type, value)) {
+                    if (verbose) cout << "Invalid " << col.attribute << " value in row " << i << endl;
+                    continue;
+                }
+                records.push_back({stateAbbrev, county, col.attribute, year, value});
+            }
+            continue;
+        }
+
+        const string& attr = row[file.attributeYear];
+        if (attr.empty()){
+            if (verbose) cout << "Skipping empty attribute in row " << i << endl;
+            continue;
+        }
+
+        ///Parse attribute for base and year
+        size_t usPos = attr.rfind('_');
+        if (usPos == string::npos || attr.length() - usPos - 1 != 4) {
+            //No year or invalid, skip or handle as no year
+            if (verbose) cout << "Invalid attribute format in row " << i << endl;
+            continue;
+        }
+        int year;
+        auto [end, ec] = from_chars(attr.data() + usPos + 1, attr.data() + attr.size(), year);
+        if (ec != errc() || end != attr.data() + attr.size()) {
+            if (verbose) cout << "Invalid year in row " << i << endl;
+            continue;
+        }
+        if (attr.compare(0, usPos, lastRaw) != 0) {
+            lastRaw.assign(attr, 0, usPos);
+            lastName = schema.canonical(lastRaw);
+            lastType = schema.typeOf(lastName);
+        }
+
+        float value;
+        if (!parseTyped(row[file.value], lastType, value)) {
+            if (verbose) cout << "Invalid value in row " << i << endl;
+            continue;
+        }
+
+        records.push_back({stateAbbrev, county, lastName, year, value});
+    }
+    return records;
+}
+
+bool loadRecords(const Schema& schema, vector<Record>& records, bool verbose, vector<vector<string>>* firstFileRows) {
+    for (const Schema::File& file : schema.files) {
+        vector<vector<string>> rows;
+        if (!readCSV(file.path, rows)) {
+            cerr << "Error opening file " << file.path << "." << endl;
+            return false;
+        }
+        vector<Record> parsed = parseRecords(schema, file, rows, verbose);
+        if (verbose) cout << rows.size() << " rows, " << parsed.size() << " values loaded from " << file.path << "." << endl;
+        records.insert(records.end(), make_move_iterator(parsed.begin()), make_move_iterator(parsed.end()));
+        if (firstFileRows && &file == &schema.files[0]) *firstFileRows = std::move(rows);
+    }
+    return true;
+}
+
+void buildAllData(const vector<Record>& records, AllData& allData) {
+    TRACE_SCOPE("buildAllData");
+    memoryStats::Scope mem(memoryStats::Subsystem::AllData);
+    for (const auto& r : records) {
+        string path = fullStateName(r.stateAbbrev) + "/" + r.county;
+        allData[path][r.attribute][r.year] = r.value;
+    }
+}
+
+void applyRecords(AllData& allData, const vector<Record>& upserts, const vector<Record>& removals) {
+    TRACE_SCOPE("applyRecords");
+    memoryStats::Scope mem(memoryStats::Subsystem::AllData);
+    for (const auto& r : upserts) {
+        allData[fullStateName(r.stateAbbrev) + "/" + r.county][r.attribute][r.year] = r.value;
+    }
+    for (const auto& r : removals) {
+        auto county = allData.find(fullStateName(r.stateAbbrev) + "/" + r.county);
+        if (county == allData.end()) continue;
+        auto series = county->second.find(r.attribute);
+        if (series == county->second.end()) continue;
+        series->second.erase(r.year);
+        if (series->second.empty()) county->second.erase(series);
+        if (county->second.empty()) allData.erase(county);
+    }
+}
+
+void buildHashTable(const vector<Record>& records, hashTable& hashData) {
+    TRACE_SCOPE("buildHashTable");
+    memoryStats::Scope mem(memoryStats::Subsystem::HashTable);
+    //One row per entry, so size the table once instead of doubling while loading
+    hashData.reserve(static_cast<int>(records.size()));
+    for (const auto& r : records) {
+        string hashKey = r.stateAbbrev + "," + r.county + "," + r.attribute + "," + to_string(r.year);
+        hashData.insert(hashKey, to_string(r.value));
+    }
+}
+
+void buildHashTable(const AllData& allData, hashTable& hashData) {
+    TRACE_SCOPE("buildHashTable");
+    memoryStats::Scope mem(memoryStats::Subsystem::HashTable);
+    size_t total = 0;
+    for (const auto& pd : allData)
+        for (const auto& sd : pd.second) total += sd.second.size();
+    hashData.reserve(static_cast<int>(total));
+
+    for (const auto& pd : allData) {
+        size_t slash = pd.first.find('/');
+        //Full state name back to its abbreviation for the hash key
+        int stateId = geography::stateIdFromName(string_view(pd.first).substr(0, slash));
+        if (stateId < 0) continue;
+        string prefix = string(geography::kStates[stateId].abbrev) + "," + pd.first.substr(slash + 1) + ",";
+        for (const auto& sd : pd.second) {
+            for (const auto& yv : sd.second) {
+                hashData.insert(prefix + sd.first + "," + to_string(yv.first), to_string(yv.second));
+            }
+        }
+    }
+}
+
+void buildKeyFilter(const vector<Record>& records, bloomFilter& filter) {
+    TRACE_SCOPE("buildKeyFilter");
+    memoryStats::Scope mem(memoryStats::Subsystem::Indexes);
+    filter.reset(records.size());
+    char year[12];
+    for (const auto& r : records) {
+        int n = snprintf(year, sizeof(year), "%d", r.year);
+        filter.add(r.stateAbbrev, r.county, r.attribute, string_view(year, n));
+    }
+}
+
+void buildKeyFilter(const AllData& allData, bloomFilter& filter) {
+    TRACE_SCOPE("buildKeyFilter");
+    memoryStats::Scope mem(memoryStats::Subsystem::Indexes);
+    size_t total = 0;
+    for (const auto& pd : allData)
+        for (const auto& sd : pd.second) total += sd.second.size();
+    filter.reset(total);
+    char year[12];
+    for (const auto& pd : allData) {
+        size_t slash = pd.first.find('/');
+        int stateId = geography::stateIdFromName(string_view(pd.first).substr(0, slash));
+        if (stateId < 0) continue;
+        string_view county = string_view(pd.first).substr(slash + 1);
+        for (const auto& sd : pd.second) {
+            for (const auto& yv : sd.second) {
+                int n = snprintf(year, sizeof(year), "%d", yv.first);
+                filter.add(geography::kStates[stateId].abbrev, county, sd.first, string_view(year, n));
+            }
+        }
+    }
+}
+
+void buildShardedHashTable(const vector<Record>& records, shardedHashTable& hashData, int threads) {
+    TRACE_SCOPE("buildShardedHashTable");
+    if (threads < 1) threads = 1;
+    hashData.reserve(static_cast<int>(records.size()));
+    vector<thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&records, &hashData, t, threads]{
+            TRACE_SCOPE("hashInsertWorker");
+            memoryStats::Scope mem(memoryStats::Subsystem::HashTable);
+            for (size_t i = t; i < records.size(); i += threads) {
+                const Record& r = records[i];
+                hashData.insert(r.stateAbbrev + "," + r.county + "," + r.attribute + "," + to_string(r.year), to_string(r.value));
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    hashData.freeze();
+}
+
+void buildTree(const AllData& allData, Tree& tree) {
+    TRACE_SCOPE("buildTree");
+    memoryStats::Scope mem(memoryStats::Subsystem::Tree);
+    size_t total = 0;
+    for (const auto& pd : allData) {
+        for (const auto& sd : pd.second) {
+            if (!sd.second.empty()) total += sd.second.rbegin()->first - sd.second.begin()->first + 1;
+        }
+    }
+    tree.reserveValues(total);
+    vector<float> values;
+    for (const auto& pd : allData) {
+        const string& path = pd.first;
+        for (const auto& sd : pd.second) {
+            const string& dataType = sd.first;
+            const auto& yearMap = sd.second;
+            if (yearMap.empty()) continue;
+            //yearMap is sorted; lay the years out densely from the first one, NaN in gaps
+            int baseYear = yearMap.begin()->first;
+            int lastYear = yearMap.rbegin()->first;
+            values.assign(lastYear - baseYear + 1, NAN);
+            for (const auto& yv : yearMap) values[yv.first - baseYear] = yv.second;
+            tree.insert(path, dataType, baseYear, values);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef DATALOADER_H
+#define DATALOADER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "tree.h"
+#include "hashTable.h"
+#include "shardedHashTable.h"
+#include "bloomFilter.h"
+#include "schema.h"
+
+//NOTE: Replace file path with your own local path to the data file
+const char* const kDataPath = "data/cleanedUnemployment2023.csv";
+
+//One valid row of the unemployment file, already split into its parts
+struct Record {
+    std::string stateAbbrev;   //"FL"
+    std::string county;        //"Alachua County"
+    std::string attribute;     //"Unemployment_rate" (year suffix removed)
+    int year;                  //2001
+    float value;
+};
+
+//path -> seriesName -> year -> value
+typedef std::map<std::string, std::map<std::string, std::map<int, float>>> AllData;
+
+//Startup is split into these steps so main and the benchmark run the same code.
+bool readCSV(const std::string& path, std::vector<std::vector<std::string>>& rows);
+void splitCSVLine(const std::string& line, std::vector<std::string>& row);
+//rows[0] is treated as the header and skipped. Rows are read as the given file of
+//the schema; attribute names come out in their declared spelling. Without a
+//schema the built-in layout of the unemployment file is used.
+std::vector<Record> parseRecords(const std::vector<std::vector<std::string>>& rows, bool verbose = true);
+std::vector<Record> parseRecords(const Schema& schema, const Schema::File& file,
+                                 const std::vector<std::vector<std::string>>& rows, bool verbose = true);
+//Reads and parses every file of the schema, appending to records. False if one cannot be opened.
+//With firstFileRows the rows of schema.files[0] are handed back instead of dropped.
+bool loadRecords(const Schema& schema, std::vector<Record>& records, bool verbose = true,
+                 std::vector<std::vector<std::string>>* firstFileRows = nullptr);
+void buildAllData(const std::vector<Record>& records, AllData& allData);
+//Upserts then removals (value ignored) into an existing allData
+void applyRecords(AllData& allData, const std::vector<Record>& upserts, const std::vector<Record>& removals);
+void buildHashTable(const std::vector<Record>& records, hashTable& hashData);
+void buildHashTable(const AllData& allData, hashTable& hashData);
+void buildTree(const AllData& allData, Tree& tree);
+void buildKeyFilter(const std::vector<Record>& records, bloomFilter& filter);
+void buildKeyFilter(const AllData& allData, bloomFilter& filter);
+//Parallel variant of buildHashTable; freezes the table when all threads are done.
+void buildShardedHashTable(const std::vector<Record>& records, shardedHashTable& hashData, int threads);
+
+#endif //DATALOADER_H
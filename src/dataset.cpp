@@ -0,0 +1,15 @@
+#include "dataset.h"
+#include "trace.h"
+
+using namespace std;
+
+void buildIndexes(Dataset& d) {
+    TRACE_SCOPE("buildIndexes");
+    buildHashTable(d.allData, d.hashData);
+    buildTree(d.allData, d.tree);
+    d.stateData = d.tree.getDisplayData(d.schema->needWeights);
+    buildKeyFilter(d.allData, d.keyFilter);
+    d.counties.build(d.allData);
+    d.ranks.build(d.allData, d.counties);
+    d.series.build(d.allData, d.counties, d.compactSeries);
+}
@@ -0,0 +1,43 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "dataLoader.h"
+#include "schema.h"
+#include "countyIndex.h"
+#include "rankIndex.h"
+#include "seriesStore.h"
+
+//One version of the loaded data. Once published it is never modified; a
+//reload builds a whole new Dataset and swaps it in.
+struct Dataset {
+    int version = 1;
+    bool compactSeries = false;   //series keeps raw attributes compressed (--compact)
+    std::shared_ptr<const Schema> schema = Schema::builtin();   //what allData was loaded with
+    AllData allData;      //kept so the next version can be derived from it
+    hashTable hashData;
+    Tree tree;
+    std::vector<float> stateData;
+    bloomFilter keyFilter;  //every (state, county, attribute, year) in hashData/tree
+    countyIndex counties;   //county names for type-ahead and search
+    rankIndex ranks;        //counties by value per (attribute, year)
+    seriesStore series;     //year-major columns, raw and derived
+};
+
+//Rebuilds hashData, tree, stateData, keyFilter, counties, ranks and series of d from d.allData.
+void buildIndexes(Dataset& d);
+
+//Holds the current Dataset. Readers take a snapshot and keep using that
+//version for as long as they hold it, so a publish never blocks them.
+class DatasetStore {
+public:
+    std::shared_ptr<const Dataset> snapshot() const { return current.load(std::memory_order_acquire); }
+    void publish(std::shared_ptr<const Dataset> d) { current.store(std::move(d), std::memory_order_release); }
+
+private:
+    std::atomic<std::shared_ptr<const Dataset>> current;
+};
+
+#endif //DATASET_H
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include "formula.h"
+#include "seriesKernels.h"
+#include "trace.h"
+
+using namespace std;
+
+//Recursive descent over the formula text, emitting bytecode as it goes:
+//  expr    = term (('+' | '-') term)*
+//  term    = unary (('*' | '/') unary)*
+//  unary   = '-' unary | power
+//  power   = primary ('^' unary)?
+//  primary = number | name ('[' ['-'] integer ']')? | name '(' expr (',' expr)* ')' | '(' expr ')'
+class formulaParser {
+public:
+    formulaParser(const string& text, const seriesStore& store, formula& f) : s(text), store(store), f(f) {}
+
+    bool run(string& error) {
+        ok = true;
+        expr();
+        skipSpace();
+        if (ok && pos < s.size()) fail("unexpected '" + string(1, s[pos]) + "'");
+        if (!ok) error = message;
+        return ok;
+    }
+
+private:
+    const string& s;
+    const seriesStore& store;
+    formula& f;
+    size_t pos = 0;
+    int depth = 0;
+    bool ok = true;
+    string message;
+
+    void fail(const string& what) {
+        if (!ok) return;
+        ok = false;
+        message = what + " at position " + to_string(pos + 1);
+    }
+    void skipSpace() { while (pos < s.size() && isspace((unsigned char)s[pos])) pos++; }
+    bool accept(char c) {
+        skipSpace();
+        if (pos < s.size() && s[pos] == c) { pos++; return true; }
+        return false;
+    }
+    void expect(char c) { if (!accept(c)) fail(string("expected '") + c + "'"); }
+
+    //Stack effect of each op keeps maxDepth exact
+    void emit(formula::Op op, int arg, int effect) {
+        f.code.push_back({op, arg});
+        depth += effect;
+        f.maxDepth = max(f.maxDepth, depth);
+    }
+
+    void expr() {
+        term();
+        while (ok) {
+            if (accept('+')) { term(); emit(formula::Op::Add, 0, -1); }
+            else if (accept('-')) { term(); emit(formula::Op::Sub, 0, -1); }
+            else break;
+        }
+    }
+
+    void term() {
+        unary();
+        while (ok) {
+            if (accept('*')) { unary(); emit(formula::Op::Mul, 0, -1); }
+            else if (accept('/')) { unary(); emit(formula::Op::Div, 0, -1); }
+            else break;
+        }
+    }
+
+    void unary() {
+        if (accept('-')) { unary(); emit(formula::Op::Neg, 0, 0); return; }
+        primary();
+        if (accept('^')) { unary(); emit(formula::Op::Pow, 0, -1); }
+    }
+
+    void primary() {
+        if (!ok) return;
+        skipSpace();
+        if (pos >= s.size()) { fail("unexpected end"); return; }
+        if (accept('(')) { expr(); expect(')'); return; }
+
+        char c = s[pos];
+        if (isdigit((unsigned char)c) || c == '.') {
+            const char* begin = s.c_str() + pos;
+            char* end = nullptr;
+            float v = strtof(begin, &end);
+            pos += static_cast<size_t>(end - begin);
+            f.constants.push_back(v);
+            emit(formula::Op::Const, static_cast<int>(f.constants.size() - 1), 1);
+            return;
+        }
+        if (!(isalpha((unsigned char)c) || c == '_')) { fail("unexpected '" + string(1, c) + "'"); return; }
+
+        size_t start = pos;
+        while (pos < s.size() && (isalnum((unsigned char)s[pos]) || s[pos] == '_')) pos++;
+        string name = s.substr(start, pos - start);
+
+        if (accept('(')) {
+            struct Fn { const char* name; formula::Op op; int args; };
+            static const Fn fns[] = {
+                {"min", formula::Op::Min, 2}, {"max", formula::Op::Max, 2}, {"log", formula::Op::Log, 1},
+                {"sqrt", formula::Op::Sqrt, 1}, {"abs", formula::Op::Abs, 1}, {"norm", formula::Op::Norm, 1},
+                {"scale", formula::Op::Scale, 1},
+            };
+            const Fn* fn = nullptr;
+            for (const auto& k : fns) if (name == k.name) fn = &k;
+            if (!fn) { pos = start; fail("unknown function " + name); return; }
+            int args = 0;
+            do { expr(); args++; } while (ok && accept(','));
+            expect(')');
+            if (ok && args != fn->args) { fail(name + " takes " + to_string(fn->args) + " argument(s)"); return; }
+            emit(fn->op, 0, 1 - fn->args);
+            return;
+        }
+
+        if (!store.has(name)) { pos = start; fail("unknown attribute " + name); return; }
+        formula::ColumnRef ref{name, true, 0};
+        if (accept('[')) {
+            skipSpace();
+            bool negative = accept('-');
+            skipSpace();
+            size_t numStart = pos;
+            while (pos < s.size() && isdigit((unsigned char)s[pos])) pos++;
+            if (numStart == pos) { fail("expected a year or -offset"); return; }
+            int n = atoi(s.substr(numStart, pos - numStart).c_str());
+            expect(']');
+            if (negative) ref.year = -n;
+            else if (n >= 1000) { ref.relative = false; ref.year = n; }
+            else { fail("use attr[-k] for k years back or attr[YYYY] for a fixed year"); return; }
+        }
+        f.columns.push_back(ref);
+        emit(formula::Op::Column, static_cast<int>(f.columns.size() - 1), 1);
+    }
+};
+
+bool formula::compile(const string& text, const seriesStore& store, string& error) {
+    source = text;
+    code.clear();
+    constants.clear();
+    columns.clear();
+    maxDepth = 0;
+    formulaParser parser(text, store, *this);
+    if (parser.run(error)) return true;
+    code.clear();
+    return false;
+}
+
+bool formula::evaluate(const seriesStore& store, int year, vector<float>& out) const {
+    TRACE_SCOPE("formula::evaluate");
+    if (code.empty()) return false;
+    const size_t C = store.countyCount();
+    vector<vector<float>> stack(maxDepth, vector<float>(C));
+    int sp = 0;
+    for (const Instr& in : code) {
+        float* top = sp > 0 ? stack[sp - 1].data() : nullptr;
+        float* below = sp > 1 ? stack[sp - 2].data() : nullptr;
+        switch (in.op) {
+            case Op::Const:
+                fill(stack[sp].begin(), stack[sp].end(), constants[in.arg]);
+                sp++;
+                break;
+            case Op::Column: {
+                const ColumnRef& ref = columns[in.arg];
+                if (!store.readColumn(ref.attribute, ref.relative ? year + ref.year : ref.year, stack[sp].data())) {
+                    fill(stack[sp].begin(), stack[sp].end(), NAN);
+                }
+                sp++;
+                break;
+            }
+            case Op::Add: seriesKernels::accumulate(below, top, C); sp--; break;
+            case Op::Sub: seriesKernels::difference(below, top, below, C); sp--; break;
+            case Op::Mul: seriesKernels::multiply(below, top, C); sp--; break;
+            case Op::Div: seriesKernels::divide(below, top, C); sp--; break;
+            case Op::Min: seriesKernels::minimum(below, top, C); sp--; break;
+            case Op::Max: seriesKernels::maximum(below, top, C); sp--; break;
+            case Op::Pow:
+                for (size_t i = 0; i < C; ++i) below[i] = pow(below[i], top[i]);
+                sp--;
+                break;
+            case Op::Neg: seriesKernels::scale(top, -1.0f, C); break;
+            case Op::Log:
+                for (size_t i = 0; i < C; ++i) top[i] = top[i] > 0.0f ? log(top[i]) : NAN;
+                break;
+            case Op::Sqrt:
+                for (size_t i = 0; i < C; ++i) top[i] = top[i] >= 0.0f ? sqrt(top[i]) : NAN;
+                break;
+            case Op::Abs:
+                for (size_t i = 0; i < C; ++i) top[i] = fabs(top[i]);
+                break;
+            case Op::Norm: {
+                float mean, sd;
+                size_t n;
+                seriesKernels::meanStdDev(top, C, mean, sd, n);
+                if (n > 1 && sd > 0.0f) seriesKernels::standardize(top, mean, 1.0f / sd, top, C);
+                else fill(top, top + C, NAN);
+                break;
+            }
+            case Op::Scale: {
+                float lo = INFINITY, hi = -INFINITY;
+                for (size_t i = 0; i < C; ++i) {
+                    if (isnan(top[i])) continue;
+                    lo = min(lo, top[i]);
+                    hi = max(hi, top[i]);
+                }
+                if (hi > lo) seriesKernels::standardize(top, lo, 1.0f / (hi - lo), top, C);
+                else fill(top, top + C, NAN);
+                break;
+            }
+        }
+    }
+    out.swap(stack[0]);
+    //Division by zero and the like count as missing
+    for (float& v : out) if (!isfinite(v)) v = NAN;
+    return true;
+}
+
+string formula::disassemble() const {
+    static const char* names[] = {"const", "column", "add", "sub", "mul", "div", "pow", "neg",
+                                  "min", "max", "log", "sqrt", "abs", "norm", "scale"};
+    string out;
+    for (const Instr& in : code) {
+        out += names[static_cast<int>(in.op)];
+        if (in.op == Op::Const) out += " " + to_string(constants[in.arg]);
+        if (in.op == Op::Column) {
+            const ColumnRef& ref = columns[in.arg];
+            out += " " + ref.attribute;
+            if (ref.relative && ref.year != 0) out += "[" + to_string(ref.year) + "]";
+            if (!ref.relative) out += "[" + to_string(ref.year) + "]";
+        }
+        out += "\n";
+    }
+    return out;
+}
+
+bool loadFormulas(const string& path, vector<pair<string, string>>& formulas) {
+    ifstream in(path);
+    if (!in) return false;
+    string line;
+    while (getline(in, line)) {
+        size_t eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == string::npos) continue;
+        auto trim = [](string t) {
+            t.erase(0, t.find_first_not_of(" \t\r"));
+            t.erase(t.find_last_not_of(" \t\r") + 1);
+            return t;
+        };
+        string name = trim(line.substr(0, eq)), text = trim(line.substr(eq + 1));
+        if (!name.empty() && !text.empty()) formulas.push_back({name, text});
+    }
+    return true;
+}
+
+bool saveFormula(const string& path, const string& name, const string& text) {
+    ofstream out(path, ios::app);
+    if (!out) return false;
+    out << name << " = " << text << "\n";
+    return static_cast<bool>(out);
+}
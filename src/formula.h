@@ -0,0 +1,61 @@
+#ifndef FORMULA_H
+#define FORMULA_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "seriesStore.h"
+
+//Saved formulas read by the map and written by main --formula-save
+const char* const kFormulaPath = "data/formulas.txt";
+
+//A user index expression over the series store, e.g.
+//  0.5 * norm(Unemployment_rate) - 0.3 * norm(log(Median_Household_Income))
+//  max(Unemployment_rate - Unemployment_rate[-1], 0)
+//  Unemployment_rate / Unemployment_rate[2007]
+//Names are store attributes (raw or derived). attr[-k] is k years before the
+//evaluation year, attr[YYYY] is a fixed year. Operators + - * / ^ and unary -,
+//functions min, max, log, sqrt, abs, norm (z-score over all counties) and
+//scale (0..1 over all counties).
+//
+//compile() turns the text into stack bytecode once; evaluate() runs it a whole
+//county column at a time, so each instruction is one batch kernel call.
+class formula {
+public:
+    //False with a message naming the position on a syntax error or unknown attribute
+    bool compile(const std::string& text, const seriesStore& store, std::string& error);
+
+    //One value per county (countyIndex id) for year; NaN where an input is missing.
+    //False if nothing is compiled.
+    bool evaluate(const seriesStore& store, int year, std::vector<float>& out) const;
+
+    const std::string& text() const { return source; }
+    std::string disassemble() const;
+
+private:
+    enum class Op : uint8_t { Const, Column, Add, Sub, Mul, Div, Pow, Neg, Min, Max, Log, Sqrt, Abs, Norm, Scale };
+    struct Instr {
+        Op op;
+        int arg;    //constant or column slot
+    };
+    struct ColumnRef {
+        std::string attribute;
+        bool relative;   //year is an offset from the evaluation year
+        int year;
+    };
+
+    std::string source;
+    std::vector<Instr> code;
+    std::vector<float> constants;
+    std::vector<ColumnRef> columns;
+    int maxDepth = 0;
+
+    friend class formulaParser;
+};
+
+//Saved formulas, one "name = expression" per line ('#' comments)
+bool loadFormulas(const std::string& path, std::vector<std::pair<std::string, std::string>>& formulas);
+bool saveFormula(const std::string& path, const std::string& name, const std::string& text);
+
+#endif //FORMULA_H
@@ -0,0 +1,123 @@
+#ifndef GEOGRAPHY_H
+#define GEOGRAPHY_H
+
+#include <array>
+#include <string_view>
+
+//The one state table shared by the loader, the tree and the UI.
+//States are ordered by name, which is also the order the tree stores them in,
+//and a state's id is its index in kStates.
+namespace geography {
+
+    struct State {
+        int id;
+        int fips;                  //Census FIPS state code
+        std::string_view abbrev;
+        std::string_view name;
+        int division;              //index into kDivisions
+    };
+
+    //Census divisions and the four Census regions they belong to
+    struct Division {
+        std::string_view name;
+        int region;                //index into kRegions
+    };
+    inline constexpr std::array<std::string_view, 4> kRegions = {"Northeast", "Midwest", "South", "West"};
+    inline constexpr std::array<Division, 9> kDivisions = {{
+        {"New England", 0},        {"Middle Atlantic", 0},
+        {"East North Central", 1}, {"West North Central", 1},
+        {"South Atlantic", 2},     {"East South Central", 2}, {"West South Central", 2},
+        {"Mountain", 3},           {"Pacific", 3},
+    }};
+
+    inline constexpr std::array<State, 51> kStates = {{
+        { 0,  1, "AL", "Alabama", 5},            { 1,  2, "AK", "Alaska", 8},
+        { 2,  4, "AZ", "Arizona", 7},            { 3,  5, "AR", "Arkansas", 6},
+        { 4,  6, "CA", "California", 8},         { 5,  8, "CO", "Colorado", 7},
+        { 6,  9, "CT", "Connecticut", 0},        { 7, 10, "DE", "Delaware", 4},
+        { 8, 11, "DC", "District of Columbia", 4},
+        { 9, 12, "FL", "Florida", 4},            {10, 13, "GA", "Georgia", 4},
+        {11, 15, "HI", "Hawaii", 8},             {12, 16, "ID", "Idaho", 7},
+        {13, 17, "IL", "Illinois", 2},           {14, 18, "IN", "Indiana", 2},
+        {15, 19, "IA", "Iowa", 3},               {16, 20, "KS", "Kansas", 3},
+        {17, 21, "KY", "Kentucky", 5},           {18, 22, "LA", "Louisiana", 6},
+        {19, 23, "ME", "Maine", 0},              {20, 24, "MD", "Maryland", 4},
+        {21, 25, "MA", "Massachusetts", 0},      {22, 26, "MI", "Michigan", 2},
+        {23, 27, "MN", "Minnesota", 3},          {24, 28, "MS", "Mississippi", 5},
+        {25, 29, "MO", "Missouri", 3},           {26, 30, "MT", "Montana", 7},
+        {27, 31, "NE", "Nebraska", 3},           {28, 32, "NV", "Nevada", 7},
+        {29, 33, "NH", "New Hampshire", 0},      {30, 34, "NJ", "New Jersey", 1},
+        {31, 35, "NM", "New Mexico", 7},         {32, 36, "NY", "New York", 1},
+        {33, 37, "NC", "North Carolina", 4},     {34, 38, "ND", "North Dakota", 3},
+        {35, 39, "OH", "Ohio", 2},               {36, 40, "OK", "Oklahoma", 6},
+        {37, 41, "OR", "Oregon", 8},             {38, 42, "PA", "Pennsylvania", 1},
+        {39, 44, "RI", "Rhode Island", 0},       {40, 45, "SC", "South Carolina", 4},
+        {41, 46, "SD", "South Dakota", 3},       {42, 47, "TN", "Tennessee", 5},
+        {43, 48, "TX", "Texas", 6},              {44, 49, "UT", "Utah", 7},
+        {45, 50, "VT", "Vermont", 0},            {46, 51, "VA", "Virginia", 4},
+        {47, 53, "WA", "Washington", 8},         {48, 54, "WV", "West Virginia", 4},
+        {49, 55, "WI", "Wisconsin", 2},          {50, 56, "WY", "Wyoming", 7},
+    }};
+
+    inline constexpr int kStateCount = static_cast<int>(kStates.size());
+
+    namespace detail {
+        //Perfect hash for two capital letters: (a-'A')*26 + (b-'A')
+        constexpr int abbrevSlot(std::string_view ab) {
+            if (ab.size() != 2 || ab[0] < 'A' || ab[0] > 'Z' || ab[1] < 'A' || ab[1] > 'Z') return -1;
+            return (ab[0] - 'A') * 26 + (ab[1] - 'A');
+        }
+
+        //Slot -> state id, -1 for unused slots. Built at compile time.
+        constexpr std::array<signed char, 26 * 26> buildAbbrevTable() {
+            std::array<signed char, 26 * 26> table{};
+            for (auto& t : table) t = -1;
+            for (const auto& s : kStates) table[abbrevSlot(s.abbrev)] = static_cast<signed char>(s.id);
+            return table;
+        }
+
+        inline constexpr auto kAbbrevTable = buildAbbrevTable();
+
+        constexpr bool tableIsConsistent() {
+            for (int i = 0; i < kStateCount; i++) {
+                if (kStates[i].id != i) return false;
+                if (i > 0 && !(kStates[i - 1].name < kStates[i].name)) return false;
+                if (kAbbrevTable[abbrevSlot(kStates[i].abbrev)] != i) return false;   //duplicate abbreviation
+            }
+            return true;
+        }
+        static_assert(tableIsConsistent(), "kStates must be sorted by name with unique ids and abbreviations");
+    }
+
+    //-1 if unknown
+    constexpr int stateIdFromAbbrev(std::string_view ab) {
+        int slot = detail::abbrevSlot(ab);
+        return slot < 0 ? -1 : detail::kAbbrevTable[slot];
+    }
+
+    //Binary search over the name order, -1 if unknown
+    constexpr int stateIdFromName(std::string_view name) {
+        int lo = 0, hi = kStateCount - 1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            if (kStates[mid].name == name) return mid;
+            if (kStates[mid].name < name) lo = mid + 1; else hi = mid - 1;
+        }
+        return -1;
+    }
+
+    static_assert(stateIdFromAbbrev("FL") == 9 && stateIdFromName("Florida") == 9);
+    static_assert(stateIdFromAbbrev("XX") == -1 && stateIdFromAbbrev("fl") == -1);
+
+    constexpr int regionOf(int stateId) { return kDivisions[kStates[stateId].division].region; }
+
+    constexpr int statesInRegion(int region) {
+        int n = 0;
+        for (const auto& s : kStates) n += regionOf(s.id) == region;
+        return n;
+    }
+    static_assert(statesInRegion(0) == 9 && statesInRegion(1) == 12 && statesInRegion(2) == 17 && statesInRegion(3) == 13);
+
+} // namespace geography
+
+#endif //GEOGRAPHY_H
@@ -1,4 +1,5 @@
 #include "hashTable.h"
+#include "trace.h"
 using namespace std;
 
 hashTable::hashTable(float maxLoadFactor) {
@@ -7,109 +8,157 @@ hashTable::hashTable(float maxLoadFactor) {
 
 hashTable::hashTable() {
     maxLoadFactor = 0.7f;
-    buckets = 100;
-    arr = new vector<pair<string, string>>[buckets];
 }
 
 hashTable::~hashTable() {
     delete[] arr;
+    delete[] oldArr;
 }
 
 bool hashTable::insert(const string& key, const string& value) {
-    vector<pair<string, string>>& curr = arr[hash(key, buckets)];
-    for (auto & i : curr) {
-        if (i.first == key) {
-            return false; // key has already been inserted
-        }
-    }
-    if (curr.empty()) {
-        fullBuckets++;
+    return insert(key, value, hash(key));
+}
+
+bool hashTable::insert(const string& key, const string& value, unsigned long long h) {
+    return put(key, value, h, false); // an existing key keeps its value
+}
+
+bool hashTable::upsert(const string& key, const string& value) {
+    return put(key, value, hash(key), true);
+}
+
+bool hashTable::put(const string& key, const string& value, unsigned long long h, bool overwrite) {
+    if (oldArr) migrate(rehashStep);
+    if (Entry* e = find(key, h)) {
+        if (overwrite) e->value = value;
+        return false;
     }
-    curr.push_back(pair<string, string>(key, value));
-    if (static_cast<float>(fullBuckets)/static_cast<float>(buckets) >= maxLoadFactor) { // Need to check load factor on insert
-        resize();
+    arr[h % buckets].push_back(Entry{key, value, h});
+    entries++;
+    if (static_cast<float>(entries)/static_cast<float>(buckets) >= maxLoadFactor) { // Need to check load factor on insert
+        resize(buckets*2);
     }
     return true;
 }
 
 bool hashTable::remove(const string& key) {
-    vector<pair<string, string>>& curr = arr[hash(key, buckets)];
-    for (int i = 0; i < curr.size(); i++) {
-        if (curr[i].first == key) {
-            for (int j = i+1; j < curr.size(); j++) {
-                curr[j-1] = curr[j]; // Shifting elements forward to fill the gap
+    if (oldArr) migrate(rehashStep);
+    unsigned long long h = hash(key);
+    vector<Entry>* tables[2] = {&arr[h % buckets], nullptr};
+    if (oldArr && static_cast<int>(h % oldBuckets) >= migrated) tables[1] = &oldArr[h % oldBuckets];
+    for (vector<Entry>* table : tables) {
+        if (!table) continue;
+        vector<Entry>& curr = *table;
+        for (size_t i = 0; i < curr.size(); i++) {
+            if (curr[i].hash == h && curr[i].key == key) {
+                // Order inside a bucket doesn't matter, so the last entry fills the gap
+                if (i + 1 < curr.size()) curr[i] = std::move(curr.back());
+                curr.pop_back();
+                entries--;
+                return true;
             }
-            curr.pop_back();
-            fullBuckets--;
-            return true;
         }
     }
     return false;
 }
 
-string hashTable::search(const string& state, const string& county, const string& attribute, const string& year) {
-    string key = state + "," + county + " County" + "," + attribute + "," + year; // Getting it in key format
-    vector<pair<string, string>>& curr = arr[hash(key, buckets)];
-    for (auto & i : curr) {
-        if (i.first == key) {
-            return i.second;
-        }
+string hashTable::search(const string& state, const string& county, const string& attribute, const string& year) const {
+    string key = makeKey(state, county, attribute, year);
+    const Entry* e = find(key, hash(key));
+    if (e) {
+        return e->value;
     }
     return "Not found";
 }
 
-int hashTable::hash(const string& key, int buckets) {
-    stringstream ss(key);
-    vector<string> keyData; // keyData[0] = State, keyData[1] = county, keyData[2] = attribute, keyData[3] = year
-    string data;
-    while (getline(ss, data, ',')) {
-        keyData.push_back(data);
-    }
-
-    // Did some research on the golden ratio's usage in scattering:
-    // https://softwareengineering.stackexchange.com/a/402543
-    // Inspiration also taken from using ASCII values of letters as taught in class.
+const string* hashTable::lookup(const string& key, unsigned long long h) const {
+    const Entry* e = find(key, h);
+    return e ? &e->value : nullptr;
+}
 
-    const unsigned long base = 131;
-    unsigned long hash1 = stoi(keyData[3]);
+int hashTable::probeCount(const string& key, unsigned long long h) const {
+    int probes = 0;
+    find(key, h, &probes);
+    return probes;
+}
 
-    unsigned long hash2 = 1;
-    for (char c : keyData[0]) {
-        hash2 *= base + isalpha(c);
-    }
+string hashTable::makeKey(const string& state, const string& county, const string& attribute, const string& year) {
+    return state + "," + county + "," + attribute + "," + year; // Getting it in key format
+}
 
-    unsigned long hash3 = 1;
-    for (char c : keyData[1]) {
-        hash3 *= base + isalpha(c);
+const hashTable::Entry* hashTable::find(const string& key, unsigned long long h, int* probes) const {
+    int seen = 0;
+    const Entry* found = nullptr;
+    for (const auto& i : arr[h % buckets]) {
+        ++seen;
+        if (i.hash == h && i.key == key) { found = &i; break; }
     }
-
-    unsigned long hash4 = 1;
-    for (char c : keyData[2]) {
-        hash4 *= base + isalpha(c);
+    // Not moved to the new table yet
+    if (!found && oldArr && static_cast<int>(h % oldBuckets) >= migrated) {
+        for (const auto& i : oldArr[h % oldBuckets]) {
+            ++seen;
+            if (i.hash == h && i.key == key) { found = &i; break; }
+        }
     }
+    if (probes) *probes += seen;
+    return found;
+}
 
-    // Use golden ratio fractional for a better spread.
-    hash1 *= 0x9e3779b9 + hash2;
-    hash1 *= 0x9e3779b9 + hash3;
-    hash1 += 0x9e3779b9 + hash4;
-
-    return hash1 % buckets;
+hashTable::Entry* hashTable::find(const string& key, unsigned long long h) {
+    // Same walk; the entry belongs to this non-const table, so handing it out mutable is safe
+    return const_cast<Entry*>(static_cast<const hashTable*>(this)->find(key, h));
 }
 
-void hashTable::resize() {
-    int newSize = buckets*2;
-    auto* newArr = new vector<pair<string, string>>[newSize];
-    for (int i = 0; i < buckets; i++) {
-        for (auto& item : arr[i]) {
-            vector<pair<string, string>>& curr = newArr[hash(item.first, newSize)];
-            curr.push_back(pair<string, string>(item.first, item.second)); // Don't need to check duplicates
-        }
+unsigned long long hashTable::hash(const string& key) {
+    // One pass over the whole key instead of splitting it into its four parts:
+    // polynomial hash on the ASCII values (base 131, as taught in class), then
+    // the golden ratio multiply to scatter the high bits back into the low ones.
+    // https://softwareengineering.stackexchange.com/a/402543
+    unsigned long long h = 0;
+    for (unsigned char c : key) {
+        h = h * 131 + c;
     }
-    delete[] arr;
-    arr = newArr;
-    buckets = newSize;
+    h ^= h >> 29;
+    h *= 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 32;
+    return h;
 }
 
+void hashTable::reserve(int n) {
+    int needed = static_cast<int>(n / maxLoadFactor) + 1;
+    if (needed <= buckets) return;
+    resize(needed);
+    finishRehash();
+}
 
+void hashTable::finishRehash() {
+    if (oldArr) migrate(oldBuckets - migrated);
+}
 
+void hashTable::resize(int newSize) {
+    TRACE_SCOPE("hashTable::resize");
+    finishRehash(); // a previous resize must be fully drained first
+    oldArr = arr;
+    oldBuckets = buckets;
+    migrated = 0;
+    arr = new vector<Entry>[newSize];
+    buckets = newSize;
+    resizes++;
+    if (rehashStep <= 0) finishRehash();
+}
 
+void hashTable::migrate(int count) {
+    int end = min(oldBuckets, migrated + count);
+    for (; migrated < end; migrated++) {
+        for (auto& item : oldArr[migrated]) {
+            arr[item.hash % buckets].push_back(std::move(item)); // Don't need to check duplicates
+        }
+        vector<Entry>().swap(oldArr[migrated]);
+    }
+    if (migrated == oldBuckets) {
+        delete[] oldArr;
+        oldArr = nullptr;
+        oldBuckets = 0;
+        migrated = 0;
+    }
+}
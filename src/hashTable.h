@@ -10,19 +10,53 @@
 
 class hashTable {
 private:
+    struct Entry {
+        std::string key;
+        std::string value;
+        unsigned long long hash;   // full hash, kept so resizing never rehashes the key
+    };
+
     float maxLoadFactor;
-    int buckets;
-    int fullBuckets = 0;
-    std::vector<std::pair<std::string, std::string>>* arr = new std::vector<std::pair<std::string, std::string>>[buckets];
-    int hash(const std::string& key, int buckets);
-    void resize();
+    int buckets = 100;
+    int entries = 0;
+    int resizes = 0;
+    int rehashStep = 2;            // old buckets migrated per operation, 0 = whole table at once
+    std::vector<Entry>* arr = new std::vector<Entry>[buckets];
+
+    // While a resize is in progress the previous table stays alive and is
+    // drained a few buckets at a time; buckets [0, migrated) are already moved.
+    std::vector<Entry>* oldArr = nullptr;
+    int oldBuckets = 0;
+    int migrated = 0;
+
+    const Entry* find(const std::string& key, unsigned long long h, int* probes = nullptr) const;   // probes += entries compared
+    Entry* find(const std::string& key, unsigned long long h);
+    // insert and upsert; with overwrite an existing key takes the new value. True if the key was new.
+    bool put(const std::string& key, const std::string& value, unsigned long long h, bool overwrite);
+    void resize(int newSize);
+    void migrate(int count);
 
 public:
     hashTable(float maxLoadFactor);
     hashTable();
+    hashTable(const hashTable&) = delete;   //owns raw bucket array, never copy
+    hashTable& operator=(const hashTable&) = delete;
     bool insert(const std::string& key, const std::string& value);
-    bool remove(const std::string& key);
-    std::string search(const std::string& state, const std::string& county, const std::string& attribute, const std::string& year);
+    bool insert(const std::string& key, const std::string& value, unsigned long long h);   // h = hash(key)
+    bool upsert(const std::string& key, const std::string& value);   // true if the key was new
+    bool remove(const std::string& key);   // O(1) once the bucket is found
+    // county is the full name as in the data: "Alachua County", "Orleans Parish"
+    std::string search(const std::string& state, const std::string& county, const std::string& attribute, const std::string& year) const;
+    const std::string* lookup(const std::string& key, unsigned long long h) const;   // nullptr if missing
+    int probeCount(const std::string& key, unsigned long long h) const;   // entries lookup() compares against
+    static std::string makeKey(const std::string& state, const std::string& county, const std::string& attribute, const std::string& year);
+    static unsigned long long hash(const std::string& key);
+    void reserve(int n);            // size for n entries up front, no resizes while loading
+    void setRehashStep(int step) { rehashStep = step; }
+    void finishRehash();            // move any remaining old buckets now
+    int size() const { return entries; }
+    int bucketCount() const { return buckets; }
+    int resizeCount() const { return resizes; }
     ~hashTable();
 };
 
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include "hotReload.h"
+#include "trace.h"
+
+using namespace std;
+
+namespace {
+    const char kKeySep = '\x1f';   //joins the key cells of an identity; never inside a CSV cell
+
+    //Row identity = the file's key cells; the hash covers every cell, so a scan
+    //and the seed rows compare the same way
+    void rowKey(const vector<string>& row, const vector<int>& keyColumns, string& id, size_t& h) {
+        id.clear();
+        for (size_t k = 0; k < keyColumns.size(); ++k) {
+            if (k) id += kKeySep;
+            if (static_cast<size_t>(keyColumns[k]) < row.size()) id += row[keyColumns[k]];
+        }
+        string all;
+        for (size_t i = 0; i < row.size(); ++i) {
+            if (i) all += ',';
+            all += row[i];
+        }
+        h = hash<string>()(all);
+    }
+
+    bool lastWrite(const string& path, filesystem::file_time_type& out) {
+        error_code ec;
+        out = filesystem::last_write_time(path, ec);
+        return !ec;
+    }
+}
+
+CsvWatcher::CsvWatcher(const Schema::File& file, DatasetStore& store, int pollMs)
+    : file(file), store(store), pollMs(pollMs) {
+    keyColumns = {file.state, file.county};
+    if (!file.wide) keyColumns.push_back(file.attributeYear);
+    else if (file.yearColumn >= 0) keyColumns.push_back(file.yearColumn);
+}
+
+CsvWatcher::~CsvWatcher() {
+    stop();
+}
+
+void CsvWatcher::seed(const vector<vector<string>>& rows) {
+    rowHashes.clear();
+    rowHashes.reserve(rows.size());
+    string id;
+    size_t h;
+    for (size_t i = 1; i < rows.size(); ++i) {
+        rowKey(rows[i], keyColumns, id, h);
+        rowHashes[id] = h;
+    }
+    seeded = true;
+}
+
+void CsvWatcher::start() {
+    if (worker.joinable()) return;
+    stopping = false;
+    worker = thread(&CsvWatcher::run, this);
+}
+
+void CsvWatcher::stop() {
+    {
+        lock_guard<mutex> g(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void CsvWatcher::run() {
+    TRACE_THREAD_NAME("csv watcher");
+    vector<vector<string>> changed, removed;
+    //Seeded: the baseline is what the Dataset was built from, and the first poll
+    //scans whatever the file holds now. Otherwise the first scan is the baseline.
+    filesystem::file_time_type seen{};
+    if (!seeded) {
+        lastWrite(file.path, seen);
+        scan(changed, removed);
+    }
+
+    unique_lock<mutex> g(lock);
+    while (!wake.wait_for(g, chrono::milliseconds(pollMs), [&]{ return stopping; })) {
+        filesystem::file_time_type now;
+        if (!lastWrite(file.path, now) || now == seen) continue;
+        if (!store.snapshot()) continue;   //started before the first publish
+        //Wait one more poll so a file still being written is not read half way
+        if (wake.wait_for(g, chrono::milliseconds(pollMs), [&]{ return stopping; })) break;
+        filesystem::file_time_type settled;
+        if (!lastWrite(file.path, settled) || settled != now) continue;
+        seen = settled;
+
+        g.unlock();
+        changed.clear();
+        removed.clear();
+        if (scan(changed, removed) && (changed.size() > 1 || removed.size() > 1)) {
+            apply(changed, removed);
+        }
+        g.lock();
+    }
+}
+
+bool CsvWatcher::scan(vector<vector<string>>& changed, vector<vector<string>>& removed) {
+    TRACE_SCOPE("CsvWatcher::scan");
+    ifstream in(file.path);
+    if (!in.is_open()) return false;
+
+    //Row 0 is a header for parseRecords
+    changed.assign(1, {});
+    removed.assign(1, {});
+    unordered_map<string, size_t> next;
+    next.reserve(rowHashes.size());
+    string line, id;
+    vector<string> row, drop;
+    size_t h;
+    bool header = true;
+    while (getline(in, line)) {
+        if (header) { header = false; continue; }
+        row.clear();
+        splitCSVLine(line, row);
+        if (row.empty()) continue;
+        rowKey(row, keyColumns, id, h);
+        auto it = rowHashes.find(id);
+        if (it == rowHashes.end() || it->second != h) {
+            changed.push_back(row);
+            //Cells emptied in a row that was there before drop their values
+            if (it != rowHashes.end() && removalRow(id, &row, drop)) removed.push_back(drop);
+        }
+        next[id] = h;
+    }
+    for (const auto& kv : rowHashes) {
+        if (next.count(kv.first)) continue;
+        if (removalRow(kv.first, nullptr, drop)) removed.push_back(drop);
+    }
+    rowHashes.swap(next);
+    return true;
+}
+
+void CsvWatcher::apply(const vector<vector<string>>& changed, const vector<vector<string>>& removed) {
+    TRACE_SCOPE("CsvWatcher::apply");
+    auto tA = chrono::steady_clock::now();
+    shared_ptr<const Dataset> current = store.snapshot();
+    const Schema& schema = *current->schema;
+    vector<Record> upserts = parseRecords(schema, file, changed, false);
+    vector<Record> removals = parseRecords(schema, file, removed, false);
+
+    auto next = make_shared<Dataset>();
+    next->version = current->version + 1;
+    next->compactSeries = current->compactSeries;
+    next->schema = current->schema;
+    next->allData = current->allData;
+    applyRecords(next->allData, upserts, removals);
+    buildIndexes(*next);
+    store.publish(next);
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - tA).count();
+    cout << "Reloaded " << file.path << ": " << upserts.size() << " changed, " << removals.size()
+         << " removed values -> version " << next->version << " (" << ms << " ms)" << endl;
+}
+
+bool CsvWatcher::removalRow(const string& id, const vector<string>* row, vector<string>& out) const {
+    out.assign(max(file.minColumns, file.columns.size()), "");
+    size_t start = 0;
+    for (int c : keyColumns) {
+        size_t end = id.find(kKeySep, start);
+        out[c] = id.substr(start, end - start);
+        start = end + 1;
+    }
+    bool any = false;
+    for (size_t c = 0; c < file.columns.size(); ++c) {
+        Schema::Role role = file.columns[c].role;
+        if (role != Schema::Role::Value && role != Schema::Role::Attribute) continue;
+        if (row && c < row->size() && !(*row)[c].empty()) continue;
+        out[c] = "0";
+        any = true;
+    }
+    return any;
+}
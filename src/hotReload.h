@@ -0,0 +1,54 @@
+#ifndef HOTRELOAD_H
+#define HOTRELOAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "dataset.h"
+
+//Watches one data file of the schema on a background thread. When it changes,
+//only the rows whose text differs from the last scan are parsed; they are applied to
+//a copy of the current allData, the indexes are rebuilt off the UI thread and
+//the new Dataset is published to the store.
+class CsvWatcher {
+public:
+    CsvWatcher(const Schema::File& file, DatasetStore& store, int pollMs = 1000);
+    ~CsvWatcher();
+    CsvWatcher(const CsvWatcher&) = delete;
+    CsvWatcher& operator=(const CsvWatcher&) = delete;
+
+    //The rows (header first, as readCSV returns them) the published Dataset was
+    //built from. Call before start(); the first poll then compares the file
+    //against them, so a write made while loading is still picked up.
+    void seed(const std::vector<std::vector<std::string>>& rows);
+    void start();
+    void stop();
+
+private:
+    void run();
+    bool scan(std::vector<std::vector<std::string>>& changed, std::vector<std::vector<std::string>>& removed);
+    void apply(const std::vector<std::vector<std::string>>& changed, const std::vector<std::vector<std::string>>& removed);
+    //A row that parses to the values to drop: the key cells of id and "0" in each
+    //value cell that is empty in row (all of them without row). False if there are none.
+    bool removalRow(const std::string& id, const std::vector<std::string>* row, std::vector<std::string>& out) const;
+
+    Schema::File file;
+    DatasetStore& store;
+    int pollMs;
+
+    //Columns that tell rows apart: state, county and attribute_year (long) or year (wide)
+    std::vector<int> keyColumns;
+    //Key cells of a row (the row identity) -> hash of the whole row
+    std::unordered_map<std::string, size_t> rowHashes;
+    bool seeded = false;
+
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+#endif //HOTRELOAD_H
@@ -3,172 +3,579 @@
 //the University of Florida.
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <vector>
-#include <algorithm>
-#include <map>
 #include <string>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include "tree.h"
 #include "hashTable.h"
+#include "dataLoader.h"
+#include "dataset.h"
+#include "schema.h"
+#include "countyIndex.h"
+#include "rankIndex.h"
+#include "seriesStore.h"
+#include "correlation.h"
+#include "formula.h"
+#include "geography.h"
+#include "hotReload.h"
+#include "benchmark.h"
+#include "trace.h"
+#include "memoryStats.h"
 #include "Visualization.h"
+#include "queryServer.h"
+#include "dataExport.h"
 
 using namespace std;
 
-int main() {
-    //State abbreviation to full name map
-    map<string, string> abbrevToFull = {
-        {"AL", "Alabama"}, {"AK", "Alaska"}, {"AZ", "Arizona"}, {"AR", "Arkansas"},
-        {"CA", "California"}, {"CO", "Colorado"}, {"CT", "Connecticut"}, {"DE", "Delaware"},
-        {"DC", "District of Columbia"}, {"FL", "Florida"}, {"GA", "Georgia"}, {"HI", "Hawaii"},
-        {"ID", "Idaho"}, {"IL", "Illinois"}, {"IN", "Indiana"}, {"IA", "Iowa"},
-        {"KS", "Kansas"}, {"KY", "Kentucky"}, {"LA", "Louisiana"}, {"ME", "Maine"},
-        {"MD", "Maryland"}, {"MA", "Massachusetts"}, {"MI", "Michigan"}, {"MN", "Minnesota"},
-        {"MS", "Mississippi"}, {"MO", "Missouri"}, {"MT", "Montana"}, {"NE", "Nebraska"},
-        {"NV", "Nevada"}, {"NH", "New Hampshire"}, {"NJ", "New Jersey"}, {"NM", "New Mexico"},
-        {"NY", "New York"}, {"NC", "North Carolina"}, {"ND", "North Dakota"}, {"OH", "Ohio"},
-        {"OK", "Oklahoma"}, {"OR", "Oregon"}, {"PA", "Pennsylvania"}, {"RI", "Rhode Island"},
-        {"SC", "South Carolina"}, {"SD", "South Dakota"}, {"TN", "Tennessee"}, {"TX", "Texas"},
-        {"UT", "Utah"}, {"VT", "Vermont"}, {"VA", "Virginia"}, {"WA", "Washington"},
-        {"WV", "West Virginia"}, {"WI", "Wisconsin"}, {"WY", "Wyoming"}
-    };
-    //Load Data
-    vector<vector<string>> unemploymentData;
-    //NOTE: Replace file path with your own local path to the data file
-    ifstream file("data/cleanedUnemployment2023.csv");
-    if (!file.is_open()) {
-        cerr << "Error opening file." << endl;
+//data/schema.txt if present, else the built-in unemployment layout; nullptr after printing the problem
+static shared_ptr<const Schema> startupSchema() {
+    string error;
+    shared_ptr<const Schema> schema = loadSchema(kSchemaPath, error);
+    if (!schema) cerr << "Schema: " << error << endl;
+    return schema;
+}
+
+//Every file of the schema into allData; watchedRows as in loadRecords
+static bool loadData(const Schema& schema, AllData& allData, vector<vector<string>>* watchedRows = nullptr) {
+    vector<Record> records;
+    if (!loadRecords(schema, records, false, watchedRows)) return false;
+    buildAllData(records, allData);
+    return true;
+}
+
+//--rank attribute year [k] [state county]: top and bottom k counties for one
+//column, plus where the given county falls in it.
+static int runRankQuery(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << "usage: --rank attribute year [k] [state county]" << endl;
         return 1;
     }
-    string line;
-    while (getline(file, line)) {
-        vector<string> row;
-        stringstream ss(line);
-        string cell;
-        while (getline(ss, cell, ',')) {
-            //Strip quotes if present
-            if (!cell.empty() && cell.front() == '"' && cell.back() == '"') {
-                cell = cell.substr(1, cell.size() - 2);
-            }
-            row.push_back(cell);
+    string attribute = argv[2];
+    int year = atoi(argv[3]);
+    size_t k = argc > 4 ? static_cast<size_t>(max(1, atoi(argv[4]))) : 10;
+
+    shared_ptr<const Schema> schema = startupSchema();
+    AllData allData;
+    if (!schema || !loadData(*schema, allData)) return 1;
+    attribute = schema->canonical(attribute);
+    countyIndex counties;
+    counties.build(allData);
+    rankIndex ranks;
+    ranks.build(allData, counties);
+
+    const vector<rankIndex::Entry>* col = ranks.column(attribute, year);
+    if (!col) {
+        cerr << "No data for " << attribute << " " << year << endl;
+        return 1;
+    }
+    vector<rankIndex::Entry> out(k);
+    auto print = [&](const char* title, size_t n) {
+        cout << title << " " << n << " of " << col->size() << " counties, " << attribute << " " << year << ":\n";
+        for (size_t i = 0; i < n; ++i) {
+            const countyIndex::County& c = counties.counties()[out[i].county];
+            cout << "  " << (i + 1) << ". " << geography::kStates[c.stateId].abbrev << " " << c.name << "  " << out[i].value << "\n";
         }
-        if (!row.empty()){
-            unemploymentData.push_back(row);
+    };
+    print("Top", ranks.top(attribute, year, k, out.data()));
+    print("Bottom", ranks.bottom(attribute, year, k, out.data()));
+
+    if (argc > 6) {
+        int county = counties.resolve(geography::stateIdFromAbbrev(argv[5]), argv[6]);
+        float pct = ranks.percentile(attribute, year, county);
+        if (isnan(pct)) {
+            cout << argv[5] << " " << argv[6] << ": no value" << endl;
+        } else {
+            cout << argv[5] << " " << argv[6] << ": rank " << ranks.rankFromTop(attribute, year, county) << " of "
+                 << col->size() << ", percentile " << pct << endl;
         }
     }
-    file.close();
-    cout << unemploymentData.size() << " rows loaded from unemployment data file." << endl;
+    return 0;
+}
 
-    //Map to hold data: path -> seriesName -> year -> value
-    map<string, map<string, map<int, float>>> allData;
+//--corr [attribute] [--export prefix] [--threads n]: correlations between all
+//attributes over every county and year, and between the counties' series of
+//one attribute (Unemployment_rate by default).
+static int runCorrelationQuery(int argc, char* argv[]) {
+    string attribute = "Unemployment_rate", exportPrefix;
+    int threads = 0;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--export" && i + 1 < argc) exportPrefix = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+        else attribute = arg;
+    }
 
-    cout << "Loading data into Hash Table..." << endl;
+    shared_ptr<const Schema> schema = startupSchema();
+    AllData allData;
+    if (!schema || !loadData(*schema, allData)) return 1;
+    countyIndex counties;
+    counties.build(allData);
+    seriesStore series;
+    series.build(allData, counties);
+    attribute = schema->canonical(attribute);
+    if (!series.has(attribute)) {
+        cerr << "Unknown attribute " << attribute << endl;
+        return 1;
+    }
 
-    hashTable hashData;
+    //Raw attributes only; derived ones correlate with their source by construction
+    vector<string> attrs;
+    for (const auto& a : series.attributes()) {
+        if (find(series.derivedAttributes().begin(), series.derivedAttributes().end(), a) == series.derivedAttributes().end()) attrs.push_back(a);
+    }
+    vector<float> am = correlation::attributeMatrix(series, attrs, threads);
+    vector<pair<float, pair<size_t, size_t>>> attrPairs;
+    for (size_t i = 0; i < attrs.size(); ++i) {
+        for (size_t j = i + 1; j < attrs.size(); ++j) {
+            float r = am[i * attrs.size() + j];
+            if (!isnan(r)) attrPairs.push_back({r, {i, j}});
+        }
+    }
+    sort(attrPairs.begin(), attrPairs.end(), [](const auto& a, const auto& b){ return fabs(a.first) > fabs(b.first); });
+    cout << "Strongest attribute correlations (all counties and years):\n";
+    for (size_t i = 0; i < min<size_t>(10, attrPairs.size()); ++i) {
+        cout << "  " << attrs[attrPairs[i].second.first] << " ~ " << attrs[attrPairs[i].second.second] << "  r = " << attrPairs[i].first << "\n";
+    }
 
-    for (size_t i = 1; i < unemploymentData.size(); ++i) {
-        const auto& row = unemploymentData[i];
-        if (row.size() < 5 || row[0].empty()){
-            cout << "Skipping invalid row " << i << endl;
-            continue;
+    //County trajectories: row c of the year-major matrix is every countyCount-th value
+    vector<float> scratch;
+    span<const float> m = series.matrix(attribute, scratch);
+    size_t C = series.countyCount(), Y = m.size() / max<size_t>(1, C);
+    auto tA = std::chrono::steady_clock::now();
+    correlation::NormalizedRows R = correlation::normalizeRows(m.data(), C, Y, 1, C);
+    vector<float> cm = correlation::matrix(R, threads);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tA).count();
+
+    auto label = [&](size_t c) {
+        const countyIndex::County& k = counties.counties()[c];
+        return string(geography::kStates[k.stateId].abbrev) + " " + k.name;
+    };
+    vector<pair<float, pair<size_t, size_t>>> best;
+    for (size_t i = 0; i < C; ++i) {
+        for (size_t j = i + 1; j < C; ++j) {
+            float r = cm[i * C + j];
+            if (isnan(r)) continue;
+            if (best.size() < 5 || r > best.back().first) {
+                best.push_back({r, {i, j}});
+                sort(best.begin(), best.end(), [](const auto& a, const auto& b){ return a.first > b.first; });
+                if (best.size() > 5) best.pop_back();
+            }
         }
+    }
+    cout << "County " << attribute << " trajectories: " << C << " x " << C << " over " << Y << " years in " << ms << " ms\n";
+    for (const auto& b : best) {
+        cout << "  " << label(b.second.first) << " ~ " << label(b.second.second) << "  r = " << b.first << "\n";
+    }
 
-        string stateAbbrev = row[1];
-        auto it = abbrevToFull.find(stateAbbrev);
-        if (it == abbrevToFull.end()){
-            cout << "Unknown state abbreviation in row " << i << endl;
-            continue;
+    if (!exportPrefix.empty()) {
+        vector<string> countyLabels;
+        for (size_t c = 0; c < C; ++c) countyLabels.push_back(label(c));
+        bool ok = correlation::writeCSV(exportPrefix + "_attributes.csv", attrs, am) &&
+                  correlation::writeCSV(exportPrefix + "_counties.csv", countyLabels, cm);
+        if (!ok) {
+            cerr << "Cannot write " << exportPrefix << "_*.csv" << endl;
+            return 1;
         }
-        string fullState = it->second;
+        cout << "Wrote " << exportPrefix << "_attributes.csv and " << exportPrefix << "_counties.csv" << endl;
+    }
+    return 0;
+}
 
-        string county = row[2];
+//--formula "expression" [year]: compile and evaluate an index formula, or
+//--formula-save name "expression": check it and append it to kFormulaPath.
+static int runFormula(int argc, char* argv[]) {
+    bool save = string(argv[1]) == "--formula-save";
+    if (argc < (save ? 4 : 3)) {
+        cerr << "usage: --formula \"expression\" [year] | --formula-save name \"expression\"" << endl;
+        return 1;
+    }
+    string text = argv[save ? 3 : 2];
 
-        string path = fullState + "/" + county;
+    shared_ptr<const Schema> schema = startupSchema();
+    AllData allData;
+    if (!schema || !loadData(*schema, allData)) return 1;
+    countyIndex counties;
+    counties.build(allData);
+    seriesStore series;
+    series.build(allData, counties);
 
-        string attr = row[3];
-        if (attr.empty()){
-            cout << "Skipping empty attribute in row " << i << endl;
-            continue;
-        }
-        string valStr = row[4];
-        float value;
-        try {
-            value = stof(valStr);
-        } catch (const std::exception& e) {
-            cout << "Invalid value in row " << i << endl;
-            continue;
+    formula f;
+    string error;
+    if (!f.compile(text, series, error)) {
+        cerr << "Formula error: " << error << endl;
+        return 1;
+    }
+    if (save) {
+        if (!saveFormula(kFormulaPath, argv[2], text)) {
+            cerr << "Cannot write " << kFormulaPath << endl;
+            return 1;
         }
+        cout << "Saved " << argv[2] << " to " << kFormulaPath << endl;
+        return 0;
+    }
 
-        ///Parse attribute for base and year
-        size_t usPos = attr.rfind('_');
-        if (usPos == string::npos || attr.length() - usPos - 1 != 4) {
-            //No year or invalid, skip or handle as no year
-            cout << "Invalid attribute format in row " << i << endl;
-            continue;
-        }
-        string yearStr = attr.substr(usPos + 1);
-        int year;
-        try {
-            year = stoi(yearStr);
-        } catch (const std::exception& e) {
-            cout << "Invalid year in row " << i << endl;
-            continue;
+    int year = argc > 3 ? atoi(argv[3]) : series.lastYear();
+    cout << "Bytecode:\n" << f.disassemble();
+    vector<float> values;
+    auto tA = std::chrono::steady_clock::now();
+    f.evaluate(series, year, values);
+    vector<float> states(geography::kStateCount);
+    series.stateMeansOf(values, states.data());
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tA).count();
+
+    vector<size_t> order;
+    for (size_t c = 0; c < values.size(); ++c) if (!isnan(values[c])) order.push_back(c);
+    sort(order.begin(), order.end(), [&](size_t a, size_t b){ return values[a] > values[b]; });
+    cout << year << ": " << order.size() << " of " << values.size() << " counties and all states in " << ms << " ms\nHighest counties:\n";
+    for (size_t i = 0; i < min<size_t>(5, order.size()); ++i) {
+        const countyIndex::County& c = counties.counties()[order[i]];
+        cout << "  " << geography::kStates[c.stateId].abbrev << " " << c.name << "  " << values[order[i]] << "\n";
+    }
+    cout << "State means:\n";
+    for (int s = 0; s < geography::kStateCount; ++s) {
+        cout << "  " << geography::kStates[s].abbrev << " " << states[s] << ((s + 1) % 8 == 0 ? "\n" : "");
+    }
+    cout << endl;
+    return 0;
+}
+
+//--aggregate geo attribute year: cached rollup of one attribute at the nation
+//("United States"), a Census region, or a state, read from a single tree node.
+static int runAggregate(int argc, char* argv[]) {
+    if (argc < 5) {
+        cerr << "usage: --aggregate \"United States\"|region|state attribute year" << endl;
+        return 1;
+    }
+    shared_ptr<const Schema> schema = startupSchema();
+    AllData allData;
+    if (!schema || !loadData(*schema, allData)) return 1;
+    Tree tree;
+    buildTree(allData, tree);
+
+    auto tA = std::chrono::steady_clock::now();
+    Tree::Rollup r = tree.aggregate(argv[2], schema->canonical(argv[3]), atoi(argv[4]));
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tA).count();
+    if (r.count == 0) {
+        cout << "No data for " << argv[2] << " " << argv[3] << " " << argv[4] << endl;
+        return 1;
+    }
+    cout << argv[2] << " " << argv[3] << " " << argv[4] << ": " << r.count << " counties, sum " << r.sum << ", mean "
+         << r.mean() << ", min " << r.min << ", max " << r.max << "  (" << us << " us)" << endl;
+    return 0;
+}
+
+//--bench-lookup ST county attribute year [runs]: the UI's lookup benchmark for one query.
+static int runLookupBenchmark(int argc, char* argv[]) {
+    if (argc < 6) {
+        cerr << "usage: --bench-lookup ST county attribute year [runs]" << endl;
+        return 1;
+    }
+    Dataset data;
+    data.schema = startupSchema();
+    if (!data.schema || !loadData(*data.schema, data.allData)) return 1;
+    buildIndexes(data);
+
+    //Typed as in the search box: "Alachua", "alachua county" or "Orleans Parish"
+    int countyId = data.counties.resolve(geography::stateIdFromAbbrev(argv[2]), argv[3]);
+    if (countyId < 0) {
+        cerr << "Unknown county " << argv[3] << endl;
+        return 1;
+    }
+    const string& county = data.counties.counties()[countyId].name;
+    int runs = argc > 6 ? max(8, atoi(argv[6])) : 20000;
+    LookupBenchmark b = benchmarkLookup(data.hashData, data.tree, argv[2], county, data.schema->canonical(argv[4]),
+                                        atoi(argv[5]), runs, max(1, runs / 100));
+    if (!b.found) cout << "Not found in both structures; timing the miss" << endl;
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%-6s %-5s %7s %9s %9s %9s\n", "", "", "runs", "p50 ns", "p99 ns", "ns/op");
+    cout << buf;
+    auto row = [&](const char* name, const char* variant, int n, const LookupBenchmark::Timing& t){
+        snprintf(buf, sizeof(buf), "%-6s %-5s %7d %9.1f %9.1f %9.1f\n", name, variant, n, t.p50, t.p99, t.nsPerOp);
+        cout << buf;
+    };
+    row("hash", "warm", b.warmRuns, b.hashWarm);
+    row("hash", "cold", b.coldRuns, b.hashCold);
+    row("tree", "warm", b.warmRuns, b.treeWarm);
+    row("tree", "cold", b.coldRuns, b.treeCold);
+    cout << "hash probes " << b.hashProbes << ", tree node visits " << b.treeVisits
+         << ", clock overhead " << b.clockNs << " ns subtracted per run" << endl;
+    return 0;
+}
+
+//--export-maps [dir] [--threads n]: every (year, attribute or formula) map as a PNG, no window.
+static int runMapExport(int argc, char* argv[]) {
+    string outDir = "maps";
+    int threads = 0;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+        else outDir = arg;
+    }
+
+    Dataset data;
+    data.schema = startupSchema();
+    if (!data.schema || !loadData(*data.schema, data.allData)) return 1;
+    data.counties.build(data.allData);
+    data.series.build(data.allData, data.counties);
+
+    Visualization::MapRaster map;
+    if (!Visualization::loadMapRaster(map)) return 1;
+    Visualization::classifyMapRaster(map);
+    Visualization::buildMapBorders(map);
+    return Visualization::exportMaps(data, map, outDir, threads);
+}
+
+//--export-data [dir] [--csv | --columnar]: county series, state aggregates and NEED scores as files.
+static int runDataExport(int argc, char* argv[]) {
+    string outDir = "export";
+    bool csv = true, columnar = true;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--csv") columnar = false;
+        else if (arg == "--columnar") csv = false;
+        else outDir = arg;
+    }
+
+    Dataset data;
+    data.schema = startupSchema();
+    if (!data.schema || !loadData(*data.schema, data.allData)) return 1;
+    buildIndexes(data);
+    return dataExport::exportData(data, outDir, csv, columnar);
+}
+
+//--serve [port] [--watch]: load once and answer queries on localhost until "quit" on stdin.
+static int runQueryServer(int argc, char* argv[]) {
+    unsigned short port = kQueryPort;
+    bool watch = false;
+    for (int i = 2; i < argc; ++i) {
+        if (string(argv[i]) == "--watch") watch = true;
+        else port = static_cast<unsigned short>(atoi(argv[i]));
+    }
+
+    auto data = make_shared<Dataset>();
+    data->schema = startupSchema();
+    vector<vector<string>> watchedRows;
+    if (!data->schema || !loadData(*data->schema, data->allData, watch ? &watchedRows : nullptr)) return 1;
+    buildIndexes(*data);
+    DatasetStore store;
+
+    //Reloads follow the first file of the schema, starting from the rows just loaded
+    const string& watched = data->schema->files[0].path;
+    CsvWatcher watcher(data->schema->files[0], store);
+    if (watch) {
+        watcher.seed(watchedRows);
+        watchedRows = {};
+        watcher.start();
+    }
+    store.publish(data);
+    queryServer server(store);
+    if (!server.start(port)) return 1;
+    cout << "Serving " << data->tree.dataNodeCount() << " series on localhost:" << port
+         << (watch ? ", reloading " + watched + " on change" : "") << ". Type quit to stop." << endl;
+    string line;
+    while (getline(cin, line) && line != "quit") {}
+    //Without a console (stdin closed) keep serving until the process is killed
+    while (!cin && line != "quit") this_thread::sleep_for(chrono::seconds(1));
+    server.stop();
+    watcher.stop();
+    return 0;
+}
+
+//--load-test [port] [--clients n] [--seconds s] [--batch b]: measure a running --serve.
+static int runLoadTest(int argc, char* argv[]) {
+    unsigned short port = kQueryPort;
+    int clients = 4;
+    double seconds = 3.0;
+    vector<int> batches;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--clients" && i + 1 < argc) clients = atoi(argv[++i]);
+        else if (arg == "--seconds" && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (arg == "--batch" && i + 1 < argc) batches.push_back(atoi(argv[++i]));
+        else port = static_cast<unsigned short>(atoi(argv[i]));
+    }
+    if (batches.empty()) batches = {1, 16, 128};
+    return runLoadGenerator(port, clients, seconds, batches);
+}
+
+int main(int argc, char* argv[]) {
+    TRACE_THREAD_NAME("main");
+
+    //Headless modes
+    //  --bench [runs] [--baseline file] [--save-baseline]
+    //  --bench-hash
+    //  --bench-sharded [maxThreads]
+    //  --rank attribute year [k] [state county]
+    //  --corr [attribute] [--export prefix] [--threads n]
+    //  --bench-corr [maxThreads]
+    //  --bench-codec
+    //  --bench-update [corrections]
+    //  --formula "expression" [year]
+    //  --aggregate geo attribute year
+    //  --bench-lookup ST county attribute year [runs]
+    //  --formula-save name "expression"
+    //  --export-maps [dir] [--threads n]
+    //  --export-data [dir] [--csv | --columnar]
+    //  --serve [port] [--watch]
+    //  --load-test [port] [--clients n] [--seconds s] [--batch b]
+    //Interactive flags
+    //  --watch     reload the data file whenever it changes
+    //  --compact   keep raw series compressed (see columnCodec.h)
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        int runs = 5;
+        string baselinePath = "bench_baseline.txt";
+        bool saveBaseline = false;
+        for (int i = 2; i < argc; ++i) {
+            string arg = argv[i];
+            if (arg == "--baseline" && i + 1 < argc) baselinePath = argv[++i];
+            else if (arg == "--save-baseline") saveBaseline = true;
+            else runs = atoi(argv[i]);
         }
-        string base = attr.substr(0, usPos);
+        int rc = runStartupBenchmark(runs, baselinePath, saveBaseline);
+        TRACE_WRITE("trace.json");
+        return rc;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--bench-hash") {
+        return runHashInsertBenchmark();
+    }
+
+    if (argc > 1 && string(argv[1]) == "--bench-sharded") {
+        return runShardedHashBenchmark(argc > 2 ? atoi(argv[2]) : 0);
+    }
+
+    if (argc > 1 && string(argv[1]) == "--corr") {
+        return runCorrelationQuery(argc, argv);
+    }
 
-        //Store data
-        allData[path][base][year] = value;
+    if (argc > 1 && string(argv[1]) == "--bench-corr") {
+        return runCorrelationBenchmark(argc > 2 ? atoi(argv[2]) : 0);
+    }
 
-        //Store data to hash table
-        string hashHey = stateAbbrev + "," + county + "," + attr.substr(0, attr.length() - 5) + "," + attr.substr(attr.length() - 4);
-        float hashValue = value;
+    if (argc > 1 && string(argv[1]) == "--bench-codec") {
+        return runCodecBenchmark();
+    }
+
+    if (argc > 1 && string(argv[1]) == "--bench-update") {
+        return runUpdateBenchmark(argc > 2 ? atoi(argv[2]) : 0);
+    }
+
+    if (argc > 1 && (string(argv[1]) == "--formula" || string(argv[1]) == "--formula-save")) {
+        return runFormula(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "--aggregate") {
+        return runAggregate(argc, argv);
+    }
 
-        hashData.insert(hashHey, to_string(hashValue));
+    if (argc > 1 && string(argv[1]) == "--bench-lookup") {
+        return runLookupBenchmark(argc, argv);
     }
 
+    if (argc > 1 && string(argv[1]) == "--export-maps") {
+        return runMapExport(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "--export-data") {
+        return runDataExport(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "--serve") {
+        return runQueryServer(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "--load-test") {
+        return runLoadTest(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "--rank") {
+        return runRankQuery(argc, argv);
+    }
+
+    bool watch = false, compact = false;
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--watch") watch = true;
+        if (string(argv[i]) == "--compact") compact = true;
+    }
+
+    //Load Data: every file the schema lists
+    shared_ptr<const Schema> schema = startupSchema();
+    if (!schema) return 1;
+    vector<Record> records;
+    vector<vector<string>> watchedRows;
+    if (!loadRecords(*schema, records, true, watch ? &watchedRows : nullptr)) return 1;
+
+    //Map to hold data: path -> seriesName -> year -> value
+    auto data = make_shared<Dataset>();
+    data->compactSeries = compact;
+    data->schema = schema;
+    buildAllData(records, data->allData);
+
+    cout << "Loading data into Hash Table..." << endl;
+    hashTable& hashData = data->hashData;
+    buildHashTable(records, hashData);
+
     //Push data into tree structure
     cout << "Loading data into N-ary tree..." << endl;
-    Tree tree;
-    for (const auto& pd : allData) {
-        const string& path = pd.first;
-        for (const auto& sd : pd.second) {
-            const string& dataType = sd.first;
-            const auto& yearMap = sd.second;
-            vector<pair<int, float>> yearValues;
-            for (const auto& yv : yearMap) {
-                yearValues.push_back({yv.first, yv.second});
-            }
-            //Sort by year
-            sort(yearValues.begin(), yearValues.end());
-            vector<float> values;
-            vector<string> labels;
-            for (const auto& yv : yearValues) {
-                values.push_back(yv.second);
-                labels.push_back(to_string(yv.first));
-            }
-            tree.insert(path, dataType, values, labels);
-        }
-    }
+    Tree& tree = data->tree;
+    buildTree(data->allData, tree);
+    size_t treeBytes = memoryStats::usage(memoryStats::Subsystem::Tree).liveBytes;
+    cout << "Tree: " << tree.dataNodeCount() << " series, " << treeBytes / max<size_t>(1, tree.dataNodeCount())
+         << " bytes per series including geography nodes" << endl;
 
-    vector<float> stateData = tree.getDisplayData();
+    buildKeyFilter(records, data->keyFilter);
+    bloomFilter::Stats bs = data->keyFilter.stats();
+    cout << "Key filter: " << bs.keys << " keys, " << bs.bits / 8 / 1024 << " KB, " << bs.hashes
+         << " hashes, expected false positive rate " << bs.expectedFpr * 100.0 << "%" << endl;
+    data->counties.build(data->allData);
+    data->ranks.build(data->allData, data->counties);
+    data->series.build(data->allData, data->counties, compact);
+    cout << "Derived series: " << data->series.derivedAttributes().size() << " (year-over-year, 3-year mean, z-scores)" << endl;
+    cout << "Series store: " << data->series.byteSize() / 1024 << " KB" << (compact ? " (raw attributes compressed)" : "") << endl;
 
-    if(stateData.size() == 50){
+    cout << "Memory by structure:\n" << memoryStats::summary() << endl;
+
+    data->stateData = tree.getDisplayData(schema->needWeights);
+
+    int statesLoaded = 0;
+    for (float v : data->stateData) {
+        if (!isnan(v)) statesLoaded++;
+    }
+    if(statesLoaded == geography::kStateCount){
         cout << "State NEED data loaded" << endl;
+    } else {
+        cout << "State NEED data loaded for " << statesLoaded << " of " << geography::kStateCount << " states" << endl;
     }
 
     //Valiate search functionality
-    string val = tree.searchValue("AL", "Autauga", "Civilian_labor_force", "2001");
+    string val = tree.searchValue("AL", "Autauga County", "Civilian_labor_force", "2001");
     if(val == "22081.000000"){
         cout << "Tree Searching Functional" << endl;
     }
 
-    string val2 = hashData.search("FL", "Alachua", "Unemployment_rate", "2001");
+    string val2 = hashData.search("FL", "Alachua County", "Unemployment_rate", "2001");
     if(val2 == "3.500000"){
         cout << "Hash Table Searching Functional" << endl;
     }
 
-    cout << "Launching Visualization..." << endl;
-    Visualization::visualizer(tree, hashData, stateData);
+    //The watcher compares against the rows this version was built from, and runs before it is published
+    DatasetStore store;
+    CsvWatcher watcher(schema->files[0], store);
+    if (watch) {
+        watcher.seed(watchedRows);
+        watchedRows = {};
+        watcher.start();
+        cout << "Watching " << schema->files[0].path << " for changes" << endl;
+    }
+    store.publish(data);
 
-    return 0;
-}
\ No newline at end of file
+    cout << "Launching Visualization..." << endl;
+    int rc = Visualization::visualizer(store);
+    watcher.stop();
+    TRACE_WRITE("trace.json");
+    return rc;
+}
@@ -0,0 +1,133 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "memoryStats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using memoryStats::Subsystem;
+
+namespace {
+    const int kSubsystems = static_cast<int>(Subsystem::Count);
+
+    //Prepended to every block; keeps the user pointer max_align_t aligned.
+    struct alignas(std::max_align_t) Header {
+        size_t size;
+        int tag;
+    };
+
+    std::atomic<size_t> gAllocCount{0};
+    std::atomic<size_t> gAllocBytes{0};
+    std::atomic<size_t> gLiveBytes[kSubsystems];
+    std::atomic<size_t> gLiveAllocs[kSubsystems];
+    std::atomic<size_t> gTotalAllocs[kSubsystems];
+    thread_local int gCurrentTag = 0;
+}
+
+#ifdef ECONVIS_COUNT_ALLOCATIONS
+void* operator new(std::size_t n) {
+    Header* h = static_cast<Header*>(std::malloc(sizeof(Header) + n));
+    if (!h) throw std::bad_alloc();
+    h->size = n;
+    h->tag = gCurrentTag;
+    gAllocCount.fetch_add(1, std::memory_order_relaxed);
+    gAllocBytes.fetch_add(n, std::memory_order_relaxed);
+    gLiveBytes[h->tag].fetch_add(n, std::memory_order_relaxed);
+    gLiveAllocs[h->tag].fetch_add(1, std::memory_order_relaxed);
+    gTotalAllocs[h->tag].fetch_add(1, std::memory_order_relaxed);
+    return h + 1;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    Header* h = static_cast<Header*>(p) - 1;
+    gLiveBytes[h->tag].fetch_sub(h->size, std::memory_order_relaxed);
+    gLiveAllocs[h->tag].fetch_sub(1, std::memory_order_relaxed);
+    std::free(h);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    operator delete(p);
+}
+#endif //ECONVIS_COUNT_ALLOCATIONS
+
+namespace memoryStats {
+
+    Scope::Scope(Subsystem s) : previous(static_cast<Subsystem>(gCurrentTag)) {
+        gCurrentTag = static_cast<int>(s);
+    }
+
+    Scope::~Scope() {
+        gCurrentTag = static_cast<int>(previous);
+    }
+
+    size_t allocationCount() {
+        return gAllocCount.load(std::memory_order_relaxed);
+    }
+
+    size_t allocatedBytes() {
+        return gAllocBytes.load(std::memory_order_relaxed);
+    }
+
+    size_t peakRSS() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS pmc;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return pmc.PeakWorkingSetSize;
+        return 0;
+#else
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#ifdef __APPLE__
+        return static_cast<size_t>(ru.ru_maxrss);          //bytes on macOS
+#else
+        return static_cast<size_t>(ru.ru_maxrss) * 1024;   //kilobytes on Linux
+#endif
+#endif
+    }
+
+    const char* subsystemName(Subsystem s) {
+        switch (s) {
+            case Subsystem::Other:     return "Other";
+            case Subsystem::Loader:    return "CSV rows";
+            case Subsystem::AllData:   return "allData";
+            case Subsystem::Tree:      return "Tree";
+            case Subsystem::HashTable: return "hashTable";
+            case Subsystem::Indexes:   return "Indexes";
+            case Subsystem::Rasters:   return "Rasters";
+            default:                   return "?";
+        }
+    }
+
+    Usage usage(Subsystem s) {
+        int i = static_cast<int>(s);
+        Usage u;
+        u.liveBytes = gLiveBytes[i].load(std::memory_order_relaxed);
+        u.liveAllocs = gLiveAllocs[i].load(std::memory_order_relaxed);
+        u.totalAllocs = gTotalAllocs[i].load(std::memory_order_relaxed);
+        return u;
+    }
+
+    std::string summary() {
+        std::string out;
+        char buf[96];
+        size_t totalBytes = 0, totalBlocks = 0;
+        for (int i = 0; i < kSubsystems; ++i) {
+            Usage u = usage(static_cast<Subsystem>(i));
+            totalBytes += u.liveBytes;
+            totalBlocks += u.liveAllocs;
+            snprintf(buf, sizeof(buf), "%-10s %8.2f MB %9zu blocks\n",
+                     subsystemName(static_cast<Subsystem>(i)), u.liveBytes / (1024.0 * 1024.0), u.liveAllocs);
+            out += buf;
+        }
+        snprintf(buf, sizeof(buf), "%-10s %8.2f MB %9zu blocks", "Total", totalBytes / (1024.0 * 1024.0), totalBlocks);
+        out += buf;
+        return out;
+    }
+
+} // namespace memoryStats
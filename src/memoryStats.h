@@ -0,0 +1,47 @@
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+
+#include <cstddef>
+#include <string>
+
+//Process-wide allocation counters. Global operator new/delete are replaced in
+//memoryStats.cpp so every container allocation is counted, and each block
+//remembers which subsystem allocated it so live bytes can be attributed.
+//The blocks carry a header, so the replacement is only compiled in where every
+//module shares it: not on Windows with SFML DLLs, which would free blocks of the
+//other module's heap. There the counters stay 0.
+#if !defined(_WIN32) || defined(SFML_STATIC)
+#define ECONVIS_COUNT_ALLOCATIONS
+#endif
+namespace memoryStats {
+
+    enum class Subsystem { Other, Loader, AllData, Tree, HashTable, Indexes, Rasters, Count };
+
+    struct Usage {
+        size_t liveBytes = 0;     //bytes currently allocated
+        size_t liveAllocs = 0;    //blocks currently allocated
+        size_t totalAllocs = 0;   //operator new calls ever made
+    };
+
+    //Allocations made on this thread while a Scope is alive are charged to
+    //its subsystem. Scopes nest; the innermost one wins.
+    class Scope {
+    public:
+        explicit Scope(Subsystem s);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        Subsystem previous;
+    };
+
+    size_t allocationCount();   //operator new calls since start
+    size_t allocatedBytes();    //bytes requested since start
+    size_t peakRSS();           //peak resident set size in bytes, 0 if unknown
+
+    const char* subsystemName(Subsystem s);
+    Usage usage(Subsystem s);
+    std::string summary();      //one "name  MB  blocks" line per subsystem
+}
+
+#endif //MEMORYSTATS_H
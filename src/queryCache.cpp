@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include "queryCache.h"
+
+using namespace std;
+
+namespace {
+    string_view trimmed(string_view s) {
+        while (!s.empty() && isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+        while (!s.empty() && isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+        return s;
+    }
+
+    uint64_t fnv1a(const char* p, size_t n) {
+        uint64_t h = 1469598103934665603ull;
+        for (size_t i = 0; i < n; ++i) {
+            h ^= static_cast<unsigned char>(p[i]);
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+}
+
+queryCache::queryCache(size_t capacity) {
+    entries.resize(max<size_t>(1, capacity));
+    size_t b = 1;
+    while (b < 2 * entries.size()) b <<= 1;
+    buckets.assign(b, -1);
+    counters.capacity = entries.size();
+}
+
+size_t queryCache::normalize(string_view state, string_view county, string_view attribute, string_view year, char* out) {
+    state = trimmed(state);
+    county = trimmed(county);
+    attribute = trimmed(attribute);
+    year = trimmed(year);
+    if (county.size() >= 7) {
+        string_view tail = county.substr(county.size() - 7);
+        bool suffix = true;
+        for (size_t i = 0; i < 7 && suffix; ++i) suffix = tolower(static_cast<unsigned char>(tail[i])) == " county"[i];
+        if (suffix) county = trimmed(county.substr(0, county.size() - 7));
+    }
+    size_t len = state.size() + county.size() + attribute.size() + year.size() + 3;
+    if (len > kKeyBytes) return 0;
+
+    //Fields separated by a control character no name contains
+    char* p = out;
+    for (char c : state) *p++ = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+    *p++ = '\x1f';
+    for (char c : county) *p++ = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    *p++ = '\x1f';
+    p = copy(attribute.begin(), attribute.end(), p);
+    *p++ = '\x1f';
+    copy(year.begin(), year.end(), p);
+    return len;
+}
+
+void queryCache::checkVersion(int v) {
+    if (v == version) return;
+    if (used > 0) counters.invalidations++;
+    version = v;
+    used = 0;
+    head = tail = -1;
+    fill(buckets.begin(), buckets.end(), -1);
+}
+
+int32_t queryCache::find(const char* key, size_t len, uint64_t h) const {
+    for (int32_t i = buckets[h & (buckets.size() - 1)]; i >= 0; i = entries[i].chain) {
+        const Entry& e = entries[i];
+        if (e.hash == h && e.keyLen == len && memcmp(e.key, key, len) == 0) return i;
+    }
+    return -1;
+}
+
+void queryCache::unlink(int32_t i) {
+    Entry& e = entries[i];
+    if (e.prev >= 0) entries[e.prev].next = e.next;
+    else head = e.next;
+    if (e.next >= 0) entries[e.next].prev = e.prev;
+    else tail = e.prev;
+}
+
+void queryCache::pushFront(int32_t i) {
+    Entry& e = entries[i];
+    e.prev = -1;
+    e.next = head;
+    if (head >= 0) entries[head].prev = i;
+    head = i;
+    if (tail < 0) tail = i;
+}
+
+bool queryCache::get(int v, string_view state, string_view county, string_view attribute, string_view year, string& value) {
+    char key[kKeyBytes];
+    size_t len = normalize(state, county, attribute, year, key);
+    uint64_t h = fnv1a(key, len);
+    lock_guard<mutex> guard(lock);
+    checkVersion(v);
+    int32_t i = len ? find(key, len, h) : -1;
+    if (i < 0) {
+        counters.misses++;
+        return false;
+    }
+    counters.hits++;
+    if (i != head) {
+        unlink(i);
+        pushFront(i);
+    }
+    value.assign(entries[i].value, entries[i].valueLen);
+    return true;
+}
+
+void queryCache::put(int v, string_view state, string_view county, string_view attribute, string_view year, string_view value) {
+    char key[kKeyBytes];
+    size_t len = normalize(state, county, attribute, year, key);
+    if (len == 0 || value.size() > kValueBytes) return;
+    uint64_t h = fnv1a(key, len);
+    lock_guard<mutex> guard(lock);
+    checkVersion(v);
+
+    int32_t i = find(key, len, h);
+    bool fresh = i < 0;
+    if (!fresh) {
+        unlink(i);
+    } else if (used < entries.size()) {
+        i = static_cast<int32_t>(used++);
+    } else {
+        //Reuse the least recently used entry; take it out of its bucket first
+        i = tail;
+        unlink(i);
+        int32_t* link = &buckets[entries[i].hash & (buckets.size() - 1)];
+        while (*link != i) link = &entries[*link].chain;
+        *link = entries[i].chain;
+        counters.evictions++;
+    }
+
+    Entry& e = entries[i];
+    if (fresh) {
+        e.hash = h;
+        e.keyLen = static_cast<uint8_t>(len);
+        memcpy(e.key, key, len);
+        int32_t& bucket = buckets[h & (buckets.size() - 1)];
+        e.chain = bucket;
+        bucket = i;
+    }
+    e.valueLen = static_cast<uint8_t>(value.size());
+    memcpy(e.value, value.data(), value.size());
+    pushFront(i);
+}
+
+queryCache::Stats queryCache::stats() const {
+    lock_guard<mutex> guard(lock);
+    Stats s = counters;
+    s.size = used;
+    return s;
+}
@@ -0,0 +1,70 @@
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//Bounded LRU cache of (state, county, attribute, year) lookup results, put
+//in front of hashTable::search and Tree::searchValue. Queries are normalized
+//(state upper case, county lower case without " County", spaces trimmed) so
+//"fl"/"Alachua County" and "FL"/"alachua" share an entry. All storage is
+//allocated by the constructor; get and put never allocate.
+class queryCache {
+public:
+    static const size_t kKeyBytes = 96;     //longer normalized queries are not cached
+    static const size_t kValueBytes = 32;   //longer results are not cached
+
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t invalidations = 0;   //times a new dataset version emptied the cache
+        size_t size = 0;
+        size_t capacity = 0;
+        double hitRate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+    };
+
+    explicit queryCache(size_t capacity = 1024);
+    queryCache(const queryCache&) = delete;
+    queryCache& operator=(const queryCache&) = delete;
+
+    //On a hit writes the cached result to value and returns true. Entries
+    //belong to one dataset version; asking with another version empties the
+    //cache first, so a reload never serves stale values.
+    bool get(int version, std::string_view state, std::string_view county, std::string_view attribute,
+             std::string_view year, std::string& value);
+    void put(int version, std::string_view state, std::string_view county, std::string_view attribute,
+             std::string_view year, std::string_view value);
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        uint64_t hash;
+        int32_t prev, next;   //recency list, head is the most recent
+        int32_t chain;        //next entry in the same bucket
+        uint8_t keyLen, valueLen;
+        char key[kKeyBytes];
+        char value[kValueBytes];
+    };
+
+    std::vector<Entry> entries;
+    std::vector<int32_t> buckets;   //first entry of each bucket, -1 if empty
+    size_t used = 0;
+    int32_t head = -1, tail = -1;
+    int version = -1;
+    Stats counters;
+    mutable std::mutex lock;
+
+    static size_t normalize(std::string_view state, std::string_view county, std::string_view attribute,
+                            std::string_view year, char* out);
+    void checkVersion(int v);
+    int32_t find(const char* key, size_t len, uint64_t h) const;
+    void unlink(int32_t i);
+    void pushFront(int32_t i);
+};
+
+#endif //QUERYCACHE_H
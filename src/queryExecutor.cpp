@@ -0,0 +1,80 @@
+#include <algorithm>
+#include "queryExecutor.h"
+#include "trace.h"
+
+using namespace std;
+
+bool queryExecutor::Context::cancelled() const {
+    return !owner.current(channel, generation);
+}
+
+void queryExecutor::Context::post(function<void()> apply) const {
+    if (cancelled()) return;
+    lock_guard<mutex> g(owner.resultLock);
+    owner.results.push_back({channel, generation, std::move(apply)});
+}
+
+queryExecutor::queryExecutor(int threads) {
+    if (threads < 1) threads = clamp(static_cast<int>(thread::hardware_concurrency()) - 1, 1, 4);
+    for (int t = 0; t < threads; ++t) workers.emplace_back(&queryExecutor::work, this);
+}
+
+queryExecutor::~queryExecutor() {
+    for (int c = 0; c < kChannels; ++c) cancel(c);
+    {
+        lock_guard<mutex> g(jobLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers) w.join();
+}
+
+void queryExecutor::submit(int channel, function<void(const Context&)> job) {
+    uint64_t generation = generations[channel].fetch_add(1, memory_order_acq_rel) + 1;
+    {
+        lock_guard<mutex> g(jobLock);
+        jobs.push_back({channel, generation, std::move(job)});
+    }
+    wake.notify_one();
+}
+
+void queryExecutor::cancel(int channel) {
+    generations[channel].fetch_add(1, memory_order_acq_rel);
+}
+
+size_t queryExecutor::drain() {
+    {
+        lock_guard<mutex> g(resultLock);
+        if (results.empty()) return 0;
+        applying.swap(results);
+    }
+    size_t ran = 0;
+    for (Result& r : applying) {
+        //The job may have been replaced after it posted
+        if (!current(r.channel, r.generation)) continue;
+        r.apply();
+        ran++;
+    }
+    applying.clear();
+    return ran;
+}
+
+void queryExecutor::work() {
+    TRACE_THREAD_NAME("query worker");
+    unique_lock<mutex> g(jobLock);
+    while (true) {
+        wake.wait(g, [&]{ return stopping || !jobs.empty(); });
+        if (stopping) return;
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        //Replaced before it started: nothing to do
+        if (!current(job.channel, job.generation)) continue;
+        g.unlock();
+        {
+            TRACE_SCOPE("query job");
+            job.run(Context(*this, job.channel, job.generation));
+        }
+        job.run = nullptr;   //let go of the job's snapshot outside the lock
+        g.lock();
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef QUERYEXECUTOR_H
+#define QUERYEXECUTOR_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Runs queries on a small worker pool so the render loop never waits on them.
+//Jobs are submitted on a channel (one per kind of query: search, map, ...);
+//submitting again on the same channel cancels the previous job of that
+//channel. A job streams results back with Context::post; the UI thread runs
+//them in drain() once per frame, and results of a cancelled job are dropped
+//there, so a slow stale query can never overwrite a newer one.
+class queryExecutor {
+public:
+    static const int kChannels = 8;
+
+    class Context {
+    public:
+        //Long jobs check this between steps and return early
+        bool cancelled() const;
+        //apply runs on the UI thread in drain(); may be called several times
+        void post(std::function<void()> apply) const;
+
+    private:
+        friend class queryExecutor;
+        Context(queryExecutor& owner, int channel, uint64_t generation)
+            : owner(owner), channel(channel), generation(generation) {}
+        queryExecutor& owner;
+        int channel;
+        uint64_t generation;
+    };
+
+    explicit queryExecutor(int threads = 0);   //0 = cores - 1, at most 4
+    ~queryExecutor();
+    queryExecutor(const queryExecutor&) = delete;
+    queryExecutor& operator=(const queryExecutor&) = delete;
+
+    void submit(int channel, std::function<void(const Context&)> job);
+    void cancel(int channel);
+    //Applies the results posted since the last call; returns how many ran
+    size_t drain();
+
+private:
+    struct Job {
+        int channel;
+        uint64_t generation;
+        std::function<void(const Context&)> run;
+    };
+    struct Result {
+        int channel;
+        uint64_t generation;
+        std::function<void()> apply;
+    };
+
+    void work();
+    bool current(int channel, uint64_t generation) const {
+        return generations[channel].load(std::memory_order_acquire) == generation;
+    }
+
+    std::array<std::atomic<uint64_t>, kChannels> generations{};
+    std::deque<Job> jobs;
+    std::mutex jobLock;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::vector<Result> results, applying;   //applying is only touched by drain()
+    std::mutex resultLock;
+    std::vector<std::thread> workers;
+};
+
+#endif //QUERYEXECUTOR_H
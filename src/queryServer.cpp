@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "queryServer.h"
+#include "geography.h"
+#include "trace.h"
+
+using namespace std;
+
+namespace {
+    const size_t kMaxFields = 8;
+    const size_t kMaxPending = 1 << 20;   //a connection sending more without a newline is dropped
+    const size_t kMaxTop = 100;
+
+    size_t splitFields(string_view line, string_view* fields) {
+        size_t n = 0;
+        while (n < kMaxFields) {
+            size_t tab = line.find('\t');
+            fields[n++] = line.substr(0, tab);
+            if (tab == string_view::npos) break;
+            line.remove_prefix(tab + 1);
+        }
+        return n;
+    }
+
+    int stateId(string_view abbrev) {
+        if (abbrev.size() != 2) return -1;
+        char up[2] = {static_cast<char>(toupper(static_cast<unsigned char>(abbrev[0]))),
+                      static_cast<char>(toupper(static_cast<unsigned char>(abbrev[1])))};
+        return geography::stateIdFromAbbrev(string_view(up, 2));
+    }
+
+    //Shortest text that reads back as the same float, e.g. 5.8 rather than 5.80000019,
+    //and never in exponent form (200000, not 2e+05)
+    void appendNumber(string& out, float v) {
+        if (isnan(v)) return;
+        char buf[64];
+        out.append(buf, to_chars(buf, buf + sizeof(buf), v, chars_format::fixed).ptr);
+    }
+
+    bool isDerived(const Dataset& d, const string& attribute) {
+        const vector<string>& derived = d.series.derivedAttributes();
+        return find(derived.begin(), derived.end(), attribute) != derived.end();
+    }
+}
+
+queryServer::queryServer(DatasetStore& store) : store(store) {}
+
+queryServer::~queryServer() {
+    stop();
+}
+
+bool queryServer::start(unsigned short port) {
+    if (listener.listen(port, sf::IpAddress::LocalHost) != sf::Socket::Done) {
+        cerr << "Cannot listen on localhost:" << port << endl;
+        return false;
+    }
+    running = true;
+    acceptor = thread(&queryServer::acceptLoop, this);
+    return true;
+}
+
+void queryServer::stop() {
+    if (!running.exchange(false)) return;
+    if (acceptor.joinable()) acceptor.join();
+    listener.close();
+    for (auto& c : connections) {
+        if (c.worker.joinable()) c.worker.join();
+    }
+    connections.clear();
+}
+
+void queryServer::acceptLoop() {
+    TRACE_THREAD_NAME("queryServer accept");
+    sf::SocketSelector selector;
+    selector.add(listener);
+    while (running) {
+        //Finished connections are joined here so a long-running server does not collect threads
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (it->finished) {
+                it->worker.join();
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (!selector.wait(sf::milliseconds(200))) continue;
+        auto socket = make_unique<sf::TcpSocket>();
+        if (listener.accept(*socket) != sf::Socket::Done) continue;
+        connections.emplace_back();
+        Connection& c = connections.back();
+        c.socket = std::move(socket);
+        c.worker = thread(&queryServer::serve, this, ref(c));
+    }
+}
+
+void queryServer::serve(Connection& c) {
+    TRACE_THREAD_NAME("queryServer connection");
+    sf::TcpSocket& socket = *c.socket;
+    sf::SocketSelector selector;
+    selector.add(socket);
+    vector<char> buf(64 * 1024);
+    string pending, out, reply;
+    bool quit = false;
+    while (running && !quit) {
+        if (!selector.wait(sf::milliseconds(200))) continue;
+        size_t got = 0;
+        if (socket.receive(buf.data(), buf.size(), got) != sf::Socket::Done) break;
+        pending.append(buf.data(), got);
+
+        //Answer every complete line against one snapshot, then write once
+        shared_ptr<const Dataset> d = store.snapshot();
+        out.clear();
+        size_t start = 0, nl;
+        while (!quit && (nl = pending.find('\n', start)) != string::npos) {
+            string_view line(pending.data() + start, nl - start);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            start = nl + 1;
+            if (line == "QUIT") {
+                quit = true;
+                break;
+            }
+            answer(*d, line, reply);
+            out += reply;
+            out += '\n';
+        }
+        pending.erase(0, start);
+        if (pending.size() > kMaxPending) {
+            out += "ERR request too long\n";
+            quit = true;
+        }
+        size_t sent = 0;
+        if (!out.empty() && socket.send(out.data(), out.size(), sent) != sf::Socket::Done) break;
+    }
+    socket.disconnect();
+    c.finished = true;
+}
+
+void queryServer::answer(const Dataset& d, string_view request, string& reply) {
+    string_view f[kMaxFields];
+    size_t n = splitFields(request, f);
+    string_view cmd = f[0];
+    reply = "OK";
+
+    if (cmd == "INFO" && n == 1) {
+        reply += "\t" + to_string(d.version) + "\t" + to_string(d.series.firstYear()) + "\t" + to_string(d.series.lastYear()) +
+                 "\t" + to_string(d.counties.counties().size());
+        return;
+    }
+    if (cmd == "ATTRS" && n == 1) {
+        for (const auto& a : d.series.attributes()) {
+            if (!isDerived(d, a)) reply += "\t" + a;
+        }
+        return;
+    }
+    if (cmd == "COUNTIES" && n == 2) {
+        int s = stateId(f[1]);
+        if (s < 0) { reply = "ERR unknown state"; return; }
+        pair<int, int> r = d.counties.stateCounties(s);
+        for (int i = r.first; i < r.second; ++i) reply += "\t" + d.counties.counties()[i].name;
+        return;
+    }
+    if ((cmd == "TOP" || cmd == "BOTTOM") && n == 4) {
+        string attribute = d.schema->canonical(string(f[1]));
+        int year = atoi(string(f[2]).c_str());
+        size_t k = min<size_t>(kMaxTop, static_cast<size_t>(max(0, atoi(string(f[3]).c_str()))));
+        rankIndex::Entry entries[kMaxTop];
+        if (!d.ranks.column(attribute, year)) { reply = "ERR no such attribute and year"; return; }
+        size_t got = cmd == "TOP" ? d.ranks.top(attribute, year, k, entries) : d.ranks.bottom(attribute, year, k, entries);
+        const auto& names = d.counties.counties();
+        for (size_t i = 0; i < got; ++i) {
+            const countyIndex::County& c = names[entries[i].county];
+            reply += "\t";
+            reply += geography::kStates[c.stateId].abbrev;
+            reply += "\t" + c.name + "\t";
+            appendNumber(reply, entries[i].value);
+        }
+        return;
+    }
+    if ((cmd == "GET" && n == 5) || (cmd == "RANGE" && n == 6)) {
+        int s = stateId(f[1]);
+        if (s < 0) { reply = "ERR unknown state"; return; }
+        int county = d.counties.resolve(s, f[2]);
+        if (county < 0) { reply = "ERR unknown county"; return; }
+        string st(geography::kStates[s].abbrev);
+        const string& name = d.counties.counties()[county].name;
+        string attribute = d.schema->canonical(string(f[3]));
+
+        if (cmd == "GET") {
+            string year(f[4]);
+            if (!d.keyFilter.mightContain(st, name, attribute, year)) { reply = "ERR no value"; return; }
+            string key = hashTable::makeKey(st, name, attribute, year);
+            const string* v = d.hashData.lookup(key, hashTable::hash(key));
+            if (!v) {
+                d.keyFilter.reportFalsePositive();
+                reply = "ERR no value";
+                return;
+            }
+            //The table holds to_string text; reply in the same shortest form as RANGE and TOP
+            float value = NAN;
+            from_chars(v->data(), v->data() + v->size(), value);
+            reply += "\t";
+            appendNumber(reply, value);
+            return;
+        }
+        Tree::SeriesView view = d.tree.range(st, name, attribute, atoi(string(f[4]).c_str()), atoi(string(f[5]).c_str()));
+        if (view.values.empty()) { reply = "ERR no value"; return; }
+        reply += "\t" + to_string(view.firstYear);
+        for (float v : view.values) {
+            reply += "\t";
+            appendNumber(reply, v);
+        }
+        return;
+    }
+    reply = "ERR bad request";
+}
+
+namespace {
+    //Sends request lines and reads until one reply line per request has arrived
+    bool roundTrip(sf::TcpSocket& socket, const string& requests, size_t count, string& replies) {
+        size_t sent = 0;
+        if (socket.send(requests.data(), requests.size(), sent) != sf::Socket::Done) return false;
+        replies.clear();
+        char buf[64 * 1024];
+        size_t lines = 0;
+        while (lines < count) {
+            size_t got = 0;
+            if (socket.receive(buf, sizeof(buf), got) != sf::Socket::Done) return false;
+            lines += static_cast<size_t>(count_if(buf, buf + got, [](char ch){ return ch == '\n'; }));
+            replies.append(buf, got);
+        }
+        return true;
+    }
+
+    vector<string> replyFields(const string& reply) {
+        vector<string> out;
+        size_t start = 0;
+        string line = reply.substr(0, reply.find('\n'));
+        while (true) {
+            size_t tab = line.find('\t', start);
+            out.push_back(line.substr(start, tab - start));
+            if (tab == string::npos) break;
+            start = tab + 1;
+        }
+        return out;
+    }
+}
+
+//One timed run of every client at one batch size, printed as a table row
+static int loadRun(unsigned short port, int clients, double seconds, int batch, const vector<string>& pool) {
+    atomic<bool> failed{false};
+    vector<vector<double>> latencies(clients);   //batch round trips in microseconds, per client
+    vector<size_t> okReplies(clients, 0);
+    auto deadline = chrono::steady_clock::now() + chrono::duration<double>(seconds);
+    auto client = [&](int id) {
+        sf::TcpSocket socket;
+        if (socket.connect(sf::IpAddress::LocalHost, port, sf::seconds(2.f)) != sf::Socket::Done) {
+            failed = true;
+            return;
+        }
+        string requests, replies;
+        size_t next = static_cast<size_t>(id) * 977;
+        while (chrono::steady_clock::now() < deadline) {
+            requests.clear();
+            for (int i = 0; i < batch; ++i) requests += pool[next++ % pool.size()];
+            auto tA = chrono::steady_clock::now();
+            if (!roundTrip(socket, requests, static_cast<size_t>(batch), replies)) {
+                failed = true;
+                return;
+            }
+            latencies[id].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - tA).count());
+            for (size_t at = 0; at < replies.size(); ) {
+                okReplies[id] += replies.compare(at, 2, "OK") == 0;
+                size_t nl = replies.find('\n', at);
+                at = nl == string::npos ? replies.size() : nl + 1;
+            }
+        }
+        socket.send("QUIT\n", 5);
+    };
+    auto tA = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int i = 0; i < clients; ++i) threads.emplace_back(client, i);
+    for (auto& t : threads) t.join();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - tA).count();
+    if (failed) {
+        cerr << "Connection to the query server failed" << endl;
+        return 1;
+    }
+
+    vector<double> all;
+    size_t ok = 0;
+    for (int i = 0; i < clients; ++i) {
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+        ok += okReplies[i];
+    }
+    sort(all.begin(), all.end());
+    auto pct = [&](double p) { return all.empty() ? 0.0 : all[min(all.size() - 1, static_cast<size_t>(p * all.size()))]; };
+    size_t requests = all.size() * static_cast<size_t>(batch);
+    char buf[240];
+    snprintf(buf, sizeof(buf), "%-8d %-6d %12zu %12.0f %10.1f %10.1f %10.1f %10.1f %10.1f %7.1f%%\n", clients, batch, requests,
+             requests / elapsed, pct(0.50), pct(0.90), pct(0.99), pct(0.999), all.empty() ? 0.0 : all.back(),
+             requests ? 100.0 * ok / requests : 0.0);
+    cout << buf;
+    return 0;
+}
+
+int runLoadGenerator(unsigned short port, int clients, double seconds, const vector<int>& batches) {
+    clients = max(1, clients);
+
+    //Keys come from the server, so the generator needs no data file
+    sf::TcpSocket probe;
+    if (probe.connect(sf::IpAddress::LocalHost, port, sf::seconds(2.f)) != sf::Socket::Done) {
+        cerr << "No query server on localhost:" << port << endl;
+        return 1;
+    }
+    string reply;
+    if (!roundTrip(probe, "INFO\nATTRS\n", 2, reply)) return 1;
+    vector<string> info = replyFields(reply);
+    vector<string> attrs = replyFields(reply.substr(reply.find('\n') + 1));
+    if (info.size() < 5 || attrs.size() < 2) {
+        cerr << "Unexpected reply from server" << endl;
+        return 1;
+    }
+    attrs.erase(attrs.begin());
+    int firstYear = atoi(info[2].c_str()), lastYear = atoi(info[3].c_str());
+    vector<pair<string, string>> counties;   //(ST, name)
+    for (const auto& s : geography::kStates) {
+        if (!roundTrip(probe, "COUNTIES\t" + string(s.abbrev) + "\n", 1, reply)) return 1;
+        vector<string> names = replyFields(reply);
+        for (size_t i = 1; i < names.size(); ++i) counties.push_back({string(s.abbrev), names[i]});
+    }
+    probe.disconnect();
+    if (counties.empty()) {
+        cerr << "Server has no counties" << endl;
+        return 1;
+    }
+
+    //A fixed pool of requests: 80% GET, 15% RANGE, 5% TOP
+    vector<string> pool;
+    uint32_t seed = 2024;
+    auto rnd = [&](uint32_t n) { seed = seed * 1664525u + 1013904223u; return (seed >> 8) % n; };
+    for (int i = 0; i < 8192; ++i) {
+        const auto& c = counties[rnd(static_cast<uint32_t>(counties.size()))];
+        const string& attr = attrs[rnd(static_cast<uint32_t>(attrs.size()))];
+        int year = firstYear + static_cast<int>(rnd(static_cast<uint32_t>(lastYear - firstYear + 1)));
+        uint32_t kind = rnd(100);
+        if (kind < 80) pool.push_back("GET\t" + c.first + "\t" + c.second + "\t" + attr + "\t" + to_string(year) + "\n");
+        else if (kind < 95) pool.push_back("RANGE\t" + c.first + "\t" + c.second + "\t" + attr + "\t" + to_string(firstYear) + "\t" + to_string(lastYear) + "\n");
+        else pool.push_back("TOP\t" + attr + "\t" + to_string(year) + "\t10\n");
+    }
+
+    cout << "\n=== Query server load (localhost:" << port << ", " << clients << " clients, " << seconds
+         << " s per batch size, latency = batch round trip in us) ===\n";
+    char buf[240];
+    snprintf(buf, sizeof(buf), "%-8s %-6s %12s %12s %10s %10s %10s %10s %10s %8s\n", "clients", "batch", "requests",
+             "queries/s", "p50", "p90", "p99", "p99.9", "max", "OK");
+    cout << buf;
+    for (int batch : batches) {
+        if (loadRun(port, clients, seconds, max(1, batch), pool) != 0) return 1;
+    }
+    return 0;
+}
+
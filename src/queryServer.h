@@ -0,0 +1,66 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <SFML/Network.hpp>
+#include "dataset.h"
+
+const unsigned short kQueryPort = 5757;
+
+//Serves the current Dataset of a store on localhost TCP so other tools can
+//query it without loading the CSV themselves. One request per line, fields
+//separated by tabs, and exactly one reply line per request:
+//  GET      ST county attribute year        OK value
+//  RANGE    ST county attribute from to     OK firstYear v1 v2 ...   (empty field = no value)
+//  TOP      attribute year k                OK ST county value ...   (BOTTOM likewise, k <= 100)
+//  COUNTIES ST                              OK name name ...
+//  ATTRS                                    OK attribute ...          (those GET/RANGE/TOP know)
+//  INFO                                     OK version firstYear lastYear counties
+//Attributes may be given under any alias of the schema. Failures reply "ERR message". Batching: a client may send many lines at
+//once; every complete line of one read is answered in a single write.
+//Each connection is served by its own thread from a snapshot of the store
+//taken per batch, so readers never wait on each other or on a reload.
+class queryServer {
+public:
+    explicit queryServer(DatasetStore& store);
+    ~queryServer();
+    queryServer(const queryServer&) = delete;
+    queryServer& operator=(const queryServer&) = delete;
+
+    bool start(unsigned short port = kQueryPort);
+    void stop();
+
+    //The reply to one request line, without the newline
+    static void answer(const Dataset& d, std::string_view request, std::string& reply);
+
+private:
+    struct Connection {
+        std::unique_ptr<sf::TcpSocket> socket;
+        std::thread worker;
+        std::atomic<bool> finished{false};
+    };
+
+    void acceptLoop();
+    void serve(Connection& c);
+
+    DatasetStore& store;
+    sf::TcpListener listener;
+    std::thread acceptor;
+    std::list<Connection> connections;   //only touched by the acceptor thread and stop()
+    std::atomic<bool> running{false};
+};
+
+//Load generator for a running server: for each batch size, `clients`
+//connections send batches of random GET/RANGE/TOP requests (keys discovered
+//through INFO, ATTRS and COUNTIES) for `seconds`; prints queries/sec and
+//batch round-trip percentiles. Returns 1 if the server could not be reached.
+int runLoadGenerator(unsigned short port, int clients, double seconds, const std::vector<int>& batches);
+
+#endif //QUERYSERVER_H
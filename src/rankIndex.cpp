@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cmath>
+#include "rankIndex.h"
+#include "geography.h"
+#include "memoryStats.h"
+#include "trace.h"
+
+using namespace std;
+
+void rankIndex::build(const AllData& allData, const countyIndex& counties) {
+    TRACE_SCOPE("rankIndex::build");
+    memoryStats::Scope mem(memoryStats::Subsystem::Indexes);
+    columns.clear();
+    size_t countyCount = counties.counties().size();
+    for (const auto& pd : allData) {
+        size_t slash = pd.first.find('/');
+        int stateId = geography::stateIdFromName(string_view(pd.first).substr(0, slash));
+        int county = counties.resolve(stateId, string_view(pd.first).substr(slash + 1));
+        if (county < 0) continue;
+        for (const auto& sd : pd.second) {
+            auto& byYear = columns[sd.first];
+            for (const auto& yv : sd.second) {
+                if (isnan(yv.second)) continue;
+                Column& c = byYear[yv.first];
+                if (c.valueOf.empty()) c.valueOf.assign(countyCount, NAN);
+                c.sorted.push_back({county, yv.second});
+                c.valueOf[county] = yv.second;
+            }
+        }
+    }
+    for (auto& byYear : columns) {
+        for (auto& yc : byYear.second) {
+            auto& s = yc.second.sorted;
+            sort(s.begin(), s.end(), [](const Entry& a, const Entry& b){
+                return a.value != b.value ? a.value < b.value : a.county < b.county;
+            });
+            s.shrink_to_fit();
+        }
+    }
+}
+
+const rankIndex::Column* rankIndex::find(const string& attribute, int year) const {
+    auto a = columns.find(attribute);
+    if (a == columns.end()) return nullptr;
+    auto y = a->second.find(year);
+    return y == a->second.end() ? nullptr : &y->second;
+}
+
+const vector<rankIndex::Entry>* rankIndex::column(const string& attribute, int year) const {
+    const Column* c = find(attribute, year);
+    return c ? &c->sorted : nullptr;
+}
+
+size_t rankIndex::top(const string& attribute, int year, size_t k, Entry* out) const {
+    const Column* c = find(attribute, year);
+    if (!c) return 0;
+    size_t n = min(k, c->sorted.size());
+    copy_n(c->sorted.rbegin(), n, out);
+    return n;
+}
+
+size_t rankIndex::bottom(const string& attribute, int year, size_t k, Entry* out) const {
+    const Column* c = find(attribute, year);
+    if (!c) return 0;
+    size_t n = min(k, c->sorted.size());
+    copy_n(c->sorted.begin(), n, out);
+    return n;
+}
+
+float rankIndex::percentile(const string& attribute, int year, int county) const {
+    const Column* c = find(attribute, year);
+    if (!c || county < 0 || county >= static_cast<int>(c->valueOf.size()) || isnan(c->valueOf[county])) return NAN;
+    float v = c->valueOf[county];
+    auto it = upper_bound(c->sorted.begin(), c->sorted.end(), v, [](float x, const Entry& e){ return x < e.value; });
+    return 100.0f * static_cast<float>(it - c->sorted.begin()) / static_cast<float>(c->sorted.size());
+}
+
+size_t rankIndex::rankFromTop(const string& attribute, int year, int county) const {
+    const Column* c = find(attribute, year);
+    if (!c || county < 0 || county >= static_cast<int>(c->valueOf.size()) || isnan(c->valueOf[county])) return 0;
+    float v = c->valueOf[county];
+    auto it = upper_bound(c->sorted.begin(), c->sorted.end(), v, [](float x, const Entry& e){ return x < e.value; });
+    return static_cast<size_t>(c->sorted.end() - it) + 1;
+}
+
+size_t rankIndex::columnCount() const {
+    size_t n = 0;
+    for (const auto& byYear : columns) n += byYear.second.size();
+    return n;
+}
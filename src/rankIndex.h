@@ -0,0 +1,50 @@
+#ifndef RANKINDEX_H
+#define RANKINDEX_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#include "dataLoader.h"
+#include "countyIndex.h"
+
+//Counties sorted by value for every (attribute, year), so "highest
+//unemployment rate in 2010" is a slice of a column instead of a full scan.
+class rankIndex {
+public:
+    struct Entry {
+        int county;     //countyIndex id
+        float value;
+    };
+
+    void build(const AllData& allData, const countyIndex& counties);
+
+    //Counties with a value for (attribute, year), ascending by value; nullptr if
+    //there is no such column.
+    const std::vector<Entry>* column(const std::string& attribute, int year) const;
+
+    //Writes up to k entries, highest (top) or lowest (bottom) value first, and
+    //returns how many were written. O(k).
+    size_t top(const std::string& attribute, int year, size_t k, Entry* out) const;
+    size_t bottom(const std::string& attribute, int year, size_t k, Entry* out) const;
+
+    //Share of counties (0-100) whose value is at most the county's own value,
+    //or NaN if the county has none. O(log n).
+    float percentile(const std::string& attribute, int year, int county) const;
+
+    //1-based position from the top, 0 if the county has no value.
+    size_t rankFromTop(const std::string& attribute, int year, int county) const;
+
+    size_t columnCount() const;
+
+private:
+    struct Column {
+        std::vector<Entry> sorted;
+        std::vector<float> valueOf;   //by county id, NaN when missing
+    };
+    std::map<std::string, std::map<int, Column>> columns;   //attribute -> year -> column
+
+    const Column* find(const std::string& attribute, int year) const;
+};
+
+#endif //RANKINDEX_H
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include "schema.h"
+
+using namespace std;
+
+namespace {
+    //Same text as data/schema.txt, without the comments
+    const char* const kBuiltinSchema = R"(
+attribute Civilian_labor_force int
+attribute Employed int
+attribute Med_HH_Income_Percent_of_State_Total float
+attribute Median_Household_Income int
+attribute Metro code
+attribute Rural_Urban_Continuum_Code code
+attribute Unemployed int
+attribute Unemployment_rate float Unemployment_Rate
+attribute Urban_Influence_Code code
+need Civilian_labor_force -0.000005
+need Employed -0.00001
+need Med_HH_Income_Percent_of_State_Total 0.0005
+need Median_Household_Income -0.00001
+need Metro -1.0
+need Rural_Urban_Continuum_Code 0.3
+need Unemployed 0.0003
+need Unemployment_rate 0.5
+need Urban_Influence_Code 0.1
+file data/cleanedUnemployment2023.csv long
+column FIPS_Code skip
+column State state
+column Area_Name county
+column Attribute attribute_year
+column Value value
+)";
+
+    bool typeFromName(const string& s, Schema::Type& out) {
+        if (s == "float") out = Schema::Type::Float;
+        else if (s == "int") out = Schema::Type::Int;
+        else if (s == "code") out = Schema::Type::Code;
+        else return false;
+        return true;
+    }
+
+    //Resolves the key column positions of a finished file block
+    bool finishFile(Schema::File& f, string& error) {
+        for (size_t i = 0; i < f.columns.size(); ++i) {
+            int* slot = nullptr;
+            switch (f.columns[i].role) {
+                case Schema::Role::State:         slot = &f.state; break;
+                case Schema::Role::County:        slot = &f.county; break;
+                case Schema::Role::AttributeYear: slot = &f.attributeYear; break;
+                case Schema::Role::Value:         slot = &f.value; break;
+                case Schema::Role::Year:          slot = &f.yearColumn; break;
+                default: break;
+            }
+            if (!slot) continue;
+            if (*slot >= 0) {
+                error = f.path + ": column " + f.columns[i].header + " repeats a role";
+                return false;
+            }
+            *slot = static_cast<int>(i);
+        }
+        bool hasAttribute = any_of(f.columns.begin(), f.columns.end(),
+                                   [](const Schema::Column& c) { return c.role == Schema::Role::Attribute; });
+        if (f.state < 0 || f.county < 0) error = f.path + ": needs a state and a county column";
+        else if (!f.wide && (f.attributeYear < 0 || f.value < 0)) error = f.path + ": long files need attribute_year and value columns";
+        else if (f.wide && !hasAttribute) error = f.path + ": wide files need at least one attribute column";
+        else if (f.wide && f.yearColumn < 0 && f.year == 0) error = f.path + ": wide files need a year column or a year on the file line";
+        if (!error.empty()) return false;
+        //Key columns must be present; trailing empty attribute cells may be cut off
+        for (size_t i = 0; i < f.columns.size(); ++i) {
+            Schema::Role r = f.columns[i].role;
+            if (r != Schema::Role::Skip && r != Schema::Role::Attribute) f.minColumns = i + 1;
+        }
+        return true;
+    }
+}
+
+const string& Schema::canonical(const string& name) const {
+    auto it = aliases.find(name);
+    return it == aliases.end() ? name : it->second;
+}
+
+Schema::Type Schema::typeOf(const string& attribute) const {
+    for (const Attribute& a : attributes) {
+        if (a.name == attribute) return a.type;
+    }
+    return Type::Float;
+}
+
+bool Schema::parse(string_view text, Schema& out, string& error) {
+    out = Schema();
+    istringstream in{string(text)};
+    string line;
+    int lineNo = 0;
+    auto fail = [&](const string& msg) {
+        error = "line " + to_string(lineNo) + ": " + msg;
+        return false;
+    };
+    //Columns refer to attributes by their declared name, so aliases are applied once the whole text is read
+    while (getline(in, line)) {
+        ++lineNo;
+        size_t hash = line.find('#');
+        if (hash != string::npos) line.resize(hash);
+        istringstream ss(line);
+        vector<string> t;
+        string word;
+        while (ss >> word) t.push_back(word);
+        if (t.empty()) continue;
+
+        if (t[0] == "attribute") {
+            Attribute a;
+            if (t.size() < 3 || !typeFromName(t[2], a.type)) return fail("expected: attribute NAME float|int|code [ALIAS ...]");
+            a.name = t[1];
+            for (size_t i = 3; i < t.size(); ++i) out.aliases[t[i]] = a.name;
+            out.attributes.push_back(a);
+        } else if (t[0] == "need") {
+            float w;
+            if (t.size() != 3 || !parseTyped(t[2], Type::Float, w)) return fail("expected: need NAME WEIGHT");
+            out.needWeights.emplace_back(t[1], w);
+        } else if (t[0] == "file") {
+            if (t.size() < 3 || (t[2] != "long" && t[2] != "wide")) return fail("expected: file PATH long|wide [YEAR]");
+            if (!out.files.empty() && !finishFile(out.files.back(), error)) return fail(error);
+            File f;
+            f.path = t[1];
+            f.wide = t[2] == "wide";
+            if (t.size() > 3) f.year = atoi(t[3].c_str());
+            out.files.push_back(std::move(f));
+        } else if (t[0] == "column") {
+            if (out.files.empty()) return fail("column before any file line");
+            if (t.size() != 3) return fail("expected: column HEADER ROLE");
+            File& f = out.files.back();
+            Column c;
+            c.header = t[1];
+            const string& r = t[2];
+            if (r == "skip") c.role = Role::Skip;
+            else if (r == "state") c.role = Role::State;
+            else if (r == "county") c.role = Role::County;
+            else if (r == "attribute_year" && !f.wide) c.role = Role::AttributeYear;
+            else if (r == "value" && !f.wide) c.role = Role::Value;
+            else if (r == "year" && f.wide) c.role = Role::Year;
+            else if (f.wide && typeFromName(r, c.type)) {
+                c.role = Role::Attribute;
+                c.attribute = c.header;
+            }
+            else return fail("role " + r + " is not valid in a " + (f.wide ? "wide" : "long") + " file");
+            f.columns.push_back(std::move(c));
+        } else {
+            return fail("unknown keyword " + t[0]);
+        }
+    }
+    if (out.files.empty()) return fail("no file lines");
+    if (!finishFile(out.files.back(), error)) return fail(error);
+
+    for (auto& w : out.needWeights) w.first = out.canonical(w.first);
+    for (File& f : out.files) {
+        for (Column& c : f.columns) {
+            if (c.role != Role::Attribute) continue;
+            c.attribute = out.canonical(c.attribute);
+            //A declared attribute keeps its declared type
+            bool declared = any_of(out.attributes.begin(), out.attributes.end(),
+                                   [&](const Attribute& a) { return a.name == c.attribute; });
+            if (declared) c.type = out.typeOf(c.attribute);
+        }
+    }
+    return true;
+}
+
+shared_ptr<const Schema> Schema::builtin() {
+    static const shared_ptr<const Schema> schema = [] {
+        auto s = make_shared<Schema>();
+        string error;
+        parse(kBuiltinSchema, *s, error);
+        return s;
+    }();
+    return schema;
+}
+
+shared_ptr<const Schema> loadSchema(const string& path, string& error) {
+    ifstream in(path);
+    if (!in.is_open()) return Schema::builtin();
+    stringstream text;
+    text << in.rdbuf();
+    auto s = make_shared<Schema>();
+    if (!Schema::parse(text.str(), *s, error)) {
+        error = path + " " + error;
+        return nullptr;
+    }
+    return s;
+}
+
+bool parseTyped(string_view text, Schema::Type type, float& out) {
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+    while (!text.empty() && isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+    if (!text.empty() && text.front() == '+') text.remove_prefix(1);
+    if (text.empty()) return false;
+    auto [end, ec] = from_chars(text.data(), text.data() + text.size(), out);
+    if (ec != errc() || end != text.data() + text.size() || !isfinite(out)) return false;
+    switch (type) {
+        case Schema::Type::Float: return true;
+        case Schema::Type::Int:   return out == floor(out);
+        case Schema::Type::Code:  return out == floor(out) && out >= 0.0f && out <= 254.0f;
+    }
+    return false;
+}
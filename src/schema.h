@@ -0,0 +1,64 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+const char* const kSchemaPath = "data/schema.txt";
+
+//Declarative description of the input: which files to load, what their columns
+//are, the attributes with their types and alternative spellings, and the NEED
+//index weights. See data/schema.txt for the format.
+struct Schema {
+    enum class Type { Float, Int, Code };
+    enum class Role { Skip, State, County, AttributeYear, Value, Year, Attribute };
+
+    struct Column {
+        std::string header;
+        Role role = Role::Skip;
+        std::string attribute;          //Role::Attribute: canonical attribute name
+        Type type = Type::Float;        //Role::Attribute
+    };
+
+    struct File {
+        std::string path;
+        bool wide = false;              //one column per attribute instead of one row per value
+        int year = 0;                   //wide files without a year column
+        std::vector<Column> columns;    //in file order
+        //Positions of the key columns, -1 if absent; resolved when the schema is read
+        int state = -1, county = -1, attributeYear = -1, value = -1, yearColumn = -1;
+        size_t minColumns = 0;          //rows without all key columns are invalid
+    };
+
+    struct Attribute {
+        std::string name;
+        Type type = Type::Float;
+    };
+
+    std::vector<File> files;
+    std::vector<Attribute> attributes;                          //declared order
+    std::unordered_map<std::string, std::string> aliases;       //other spelling -> name
+    std::vector<std::pair<std::string, float>> needWeights;
+
+    //The declared spelling of an attribute (name itself if it has no alias)
+    const std::string& canonical(const std::string& name) const;
+    Type typeOf(const std::string& attribute) const;
+
+    //False with "line N: ..." in error if the text is not a valid schema
+    static bool parse(std::string_view text, Schema& out, std::string& error);
+    //The layout of the unemployment file, same as the shipped data/schema.txt
+    static std::shared_ptr<const Schema> builtin();
+};
+
+//Reads path if it exists, otherwise returns the built-in schema. nullptr with a
+//message in error if the file is invalid.
+std::shared_ptr<const Schema> loadSchema(const std::string& path, std::string& error);
+
+//One cell as the given type: trimmed, and whole for Int, 0..254 for Code
+bool parseTyped(std::string_view text, Schema::Type type, float& out);
+
+#endif //SCHEMA_H
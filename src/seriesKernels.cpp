@@ -0,0 +1,149 @@
+#include <cmath>
+#include "seriesKernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SERIES_SSE2 1
+#endif
+
+namespace seriesKernels {
+
+    void difference(const float* a, const float* b, float* out, size_t n) {
+        size_t i = 0;
+#ifdef SERIES_SSE2
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(out + i, _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        }
+#endif
+        for (; i < n; ++i) out[i] = a[i] - b[i];
+    }
+
+    void accumulate(float* acc, const float* x, size_t n) {
+        size_t i = 0;
+#ifdef SERIES_SSE2
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_loadu_ps(x + i)));
+        }
+#endif
+        for (; i < n; ++i) acc[i] += x[i];
+    }
+
+    void scale(float* x, float f, size_t n) {
+        size_t i = 0;
+#ifdef SERIES_SSE2
+        __m128 vf = _mm_set1_ps(f);
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(x + i, _mm_mul_ps(_mm_loadu_ps(x + i), vf));
+        }
+#endif
+        for (; i < n; ++i) x[i] *= f;
+    }
+
+    void multiply(float* acc, const float* x, size_t n) {
+        size_t i = 0;
+#ifdef SERIES_SSE2
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(acc + i, _mm_mul_ps(_mm_loadu_ps(acc + i), _mm_loadu_ps(x + i)));
+        }
+#endif
+        for (; i < n; ++i) acc[i] *= x[i];
+    }
+
+    void divide(float* acc, const float* x, size_t n) {
+        size_t i = 0;
+#ifdef SERIES_SSE2
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(acc + i, _mm_div_ps(_mm_loadu_ps(acc + i), _mm_loadu_ps(x + i)));
+        }
+#endif
+        for (; i < n; ++i) acc[i] /= x[i];
+    }
+
+    //_mm_min_ps/_mm_max_ps return the second operand when either is NaN, so
+    //NaN lanes are patched back in to keep "missing" missing
+    void minimum(float* acc, const float* x, size_t n) {
+        size_t i = 0;
+#ifdef SERIES_SSE2
+        const __m128 nan = _mm_set1_ps(NAN);
+        for (; i + 4 <= n; i += 4) {
+            __m128 a = _mm_loadu_ps(acc + i), b = _mm_loadu_ps(x + i);
+            _mm_storeu_ps(acc + i, _mm_or_ps(_mm_min_ps(a, b), _mm_and_ps(_mm_cmpunord_ps(a, b), nan)));
+        }
+#endif
+        for (; i < n; ++i) acc[i] = (std::isnan(acc[i]) || std::isnan(x[i])) ? NAN : (x[i] < acc[i] ? x[i] : acc[i]);
+    }
+
+    void maximum(float* acc, const float* x, size_t n) {
+        size_t i = 0;
+#ifdef SERIES_SSE2
+        const __m128 nan = _mm_set1_ps(NAN);
+        for (; i + 4 <= n; i += 4) {
+            __m128 a = _mm_loadu_ps(acc + i), b = _mm_loadu_ps(x + i);
+            _mm_storeu_ps(acc + i, _mm_or_ps(_mm_max_ps(a, b), _mm_and_ps(_mm_cmpunord_ps(a, b), nan)));
+        }
+#endif
+        for (; i < n; ++i) acc[i] = (std::isnan(acc[i]) || std::isnan(x[i])) ? NAN : (x[i] > acc[i] ? x[i] : acc[i]);
+    }
+
+    void meanStdDev(const float* x, size_t n, float& mean, float& sd, size_t& count) {
+        //Two passes (mean, then squared deviations) so large values such as
+        //labor force counts do not cancel out in float
+        float sum = 0.0f, cnt = 0.0f;
+        size_t i = 0;
+#ifdef SERIES_SSE2
+        __m128 vsum = _mm_setzero_ps(), vcnt = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = _mm_loadu_ps(x + i);
+            __m128 present = _mm_cmpord_ps(v, v);    //all ones where v is not NaN
+            vsum = _mm_add_ps(vsum, _mm_and_ps(present, v));
+            vcnt = _mm_add_ps(vcnt, _mm_and_ps(present, one));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, vsum); sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        _mm_storeu_ps(lanes, vcnt); cnt = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+        for (; i < n; ++i) {
+            if (std::isnan(x[i])) continue;
+            sum += x[i];
+            cnt += 1.0f;
+        }
+        count = static_cast<size_t>(cnt);
+        if (count == 0) {
+            mean = sd = NAN;
+            return;
+        }
+        mean = sum / cnt;
+
+        float sq = 0.0f;
+        i = 0;
+#ifdef SERIES_SSE2
+        __m128 vsq = _mm_setzero_ps();
+        const __m128 vmean = _mm_set1_ps(mean);
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = _mm_loadu_ps(x + i);
+            __m128 d = _mm_and_ps(_mm_cmpord_ps(v, v), _mm_sub_ps(v, vmean));
+            vsq = _mm_add_ps(vsq, _mm_mul_ps(d, d));
+        }
+        _mm_storeu_ps(lanes, vsq); sq = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+        for (; i < n; ++i) {
+            if (std::isnan(x[i])) continue;
+            float d = x[i] - mean;
+            sq += d * d;
+        }
+        sd = std::sqrt(sq / cnt);
+    }
+
+    void standardize(const float* x, float mean, float invSd, float* out, size_t n) {
+        size_t i = 0;
+#ifdef SERIES_SSE2
+        const __m128 vmean = _mm_set1_ps(mean), vinv = _mm_set1_ps(invSd);
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + i), vmean), vinv));
+        }
+#endif
+        for (; i < n; ++i) out[i] = (x[i] - mean) * invSd;
+    }
+
+} // namespace seriesKernels
@@ -0,0 +1,26 @@
+#ifndef SERIESKERNELS_H
+#define SERIESKERNELS_H
+
+#include <cstddef>
+
+//Batch kernels over contiguous float columns. SSE2 on x86 (4 lanes), plain
+//loops elsewhere. NaN marks a missing value: the elementwise kernels let it
+//propagate, the reductions skip it.
+namespace seriesKernels {
+
+    void difference(const float* a, const float* b, float* out, size_t n);   //out = a - b
+    void accumulate(float* acc, const float* x, size_t n);                   //acc += x
+    void scale(float* x, float f, size_t n);                                 //x *= f
+    void multiply(float* acc, const float* x, size_t n);                     //acc *= x
+    void divide(float* acc, const float* x, size_t n);                       //acc /= x
+    void minimum(float* acc, const float* x, size_t n);                      //acc = min(acc, x), NaN if either is
+    void maximum(float* acc, const float* x, size_t n);                      //acc = max(acc, x), NaN if either is
+
+    //Mean and standard deviation of the non-NaN values; count is how many there were.
+    void meanStdDev(const float* x, size_t n, float& mean, float& sd, size_t& count);
+
+    //out = (x - mean) * invSd
+    void standardize(const float* x, float mean, float invSd, float* out, size_t n);
+}
+
+#endif //SERIESKERNELS_H
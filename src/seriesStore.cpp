@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include "seriesStore.h"
+#include "seriesKernels.h"
+#include "geography.h"
+#include "memoryStats.h"
+#include "trace.h"
+
+using namespace std;
+
+void seriesStore::build(const AllData& allData, const countyIndex& counties, bool compact) {
+    TRACE_SCOPE("seriesStore::build");
+    memoryStats::Scope mem(memoryStats::Subsystem::Indexes);
+    matrices.clear();
+    packed.clear();
+    derived.clear();
+    nCounties = counties.counties().size();
+    stateRanges.clear();
+    for (int s = 0; s < geography::kStateCount; ++s) stateRanges.push_back(counties.stateCounties(s));
+
+    int lo = INT_MAX, hi = INT_MIN;
+    for (const auto& pd : allData) {
+        for (const auto& sd : pd.second) {
+            if (sd.second.empty()) continue;
+            lo = min(lo, sd.second.begin()->first);
+            hi = max(hi, sd.second.rbegin()->first);
+        }
+    }
+    if (lo > hi) {
+        baseYear = years = 0;
+        return;
+    }
+    baseYear = lo;
+    years = hi - lo + 1;
+
+    //Scatter allData into the raw matrices
+    map<string, vector<int>> yearsPresent;   //attribute -> counties with a value, per year
+    for (const auto& pd : allData) {
+        size_t slash = pd.first.find('/');
+        int stateId = geography::stateIdFromName(string_view(pd.first).substr(0, slash));
+        int county = counties.resolve(stateId, string_view(pd.first).substr(slash + 1));
+        if (county < 0) continue;
+        for (const auto& sd : pd.second) {
+            vector<float>& m = matrices[sd.first];
+            if (m.empty()) {
+                m.assign(static_cast<size_t>(years) * nCounties, NAN);
+                yearsPresent[sd.first].assign(years, 0);
+            }
+            vector<int>& present = yearsPresent[sd.first];
+            for (const auto& yv : sd.second) {
+                m[static_cast<size_t>(yv.first - baseYear) * nCounties + county] = yv.second;
+                if (!isnan(yv.second)) present[yv.first - baseYear]++;
+            }
+        }
+    }
+
+    //Only attributes reported for at least three years get derived series
+    for (const auto& ap : yearsPresent) {
+        int withData = 0;
+        for (int c : ap.second) withData += c > 0;
+        if (withData >= 3) deriveSeries(ap.first);
+    }
+
+    //Derived series stay float; they are rarely exact in fixed point
+    if (compact) {
+        for (const auto& ap : yearsPresent) {
+            auto it = matrices.find(ap.first);
+            packed[ap.first] = columnCodec::encode(it->second.data(), years, nCounties);
+            matrices.erase(it);
+        }
+    }
+}
+
+void seriesStore::deriveSeries(const string& attribute) {
+    const size_t C = nCounties;
+    const vector<float>& raw = matrices[attribute];
+    vector<float> yoy(raw.size(), NAN), ma3(raw.size(), NAN), zState(raw.size(), NAN), zUS(raw.size(), NAN);
+
+    for (int y = 0; y < years; ++y) {
+        const float* col = raw.data() + y * C;
+        if (y >= 1) seriesKernels::difference(col, col - C, yoy.data() + y * C, C);
+        if (y >= 2) {
+            float* out = ma3.data() + y * C;
+            copy(col, col + C, out);
+            seriesKernels::accumulate(out, col - C, C);
+            seriesKernels::accumulate(out, col - 2 * C, C);
+            seriesKernels::scale(out, 1.0f / 3.0f, C);
+        }
+
+        float mean, sd;
+        size_t n;
+        seriesKernels::meanStdDev(col, C, mean, sd, n);
+        if (n > 1 && sd > 0.0f) seriesKernels::standardize(col, mean, 1.0f / sd, zUS.data() + y * C, C);
+
+        for (const auto& r : stateRanges) {
+            size_t len = static_cast<size_t>(r.second - r.first);
+            if (len == 0) continue;
+            seriesKernels::meanStdDev(col + r.first, len, mean, sd, n);
+            if (n > 1 && sd > 0.0f) seriesKernels::standardize(col + r.first, mean, 1.0f / sd, zState.data() + y * C + r.first, len);
+        }
+    }
+
+    const pair<const char*, vector<float>*> outputs[] = {
+        {"_YoY", &yoy}, {"_MA3", &ma3}, {"_Z_State", &zState}, {"_Z_US", &zUS},
+    };
+    for (const auto& o : outputs) {
+        derived.push_back(attribute + o.first);
+        matrices[derived.back()] = std::move(*o.second);
+    }
+}
+
+span<const float> seriesStore::column(const string& attribute, int year, vector<float>& scratch) const {
+    if (year < baseYear || year > lastYear()) return {};
+    auto it = matrices.find(attribute);
+    if (it != matrices.end()) {
+        return span<const float>(it->second).subspan(static_cast<size_t>(year - baseYear) * nCounties, nCounties);
+    }
+    auto pt = packed.find(attribute);
+    if (pt == packed.end()) return {};
+    scratch.resize(nCounties);
+    columnCodec::decodeRows(pt->second, static_cast<size_t>(year - baseYear), 1, scratch.data());
+    return scratch;
+}
+
+bool seriesStore::readColumn(const string& attribute, int year, float* out) const {
+    if (year < baseYear || year > lastYear()) return false;
+    auto it = matrices.find(attribute);
+    if (it != matrices.end()) {
+        const float* col = it->second.data() + static_cast<size_t>(year - baseYear) * nCounties;
+        copy(col, col + nCounties, out);
+        return true;
+    }
+    auto pt = packed.find(attribute);
+    if (pt == packed.end()) return false;
+    columnCodec::decodeRows(pt->second, static_cast<size_t>(year - baseYear), 1, out);
+    return true;
+}
+
+float seriesStore::value(const string& attribute, int county, int year) const {
+    if (county < 0 || static_cast<size_t>(county) >= nCounties || year < baseYear || year > lastYear()) return NAN;
+    size_t row = static_cast<size_t>(year - baseYear);
+    auto it = matrices.find(attribute);
+    if (it != matrices.end()) return it->second[row * nCounties + county];
+    auto pt = packed.find(attribute);
+    if (pt == packed.end()) return NAN;
+    return columnCodec::decodeValue(pt->second, row, static_cast<size_t>(county));
+}
+
+void seriesStore::stateMeans(const string& attribute, int year, float* out) const {
+    vector<float> scratch;
+    stateMeansOf(column(attribute, year, scratch), out);
+}
+
+void seriesStore::stateMeansOf(span<const float> column, float* out) const {
+    for (int s = 0; s < geography::kStateCount; ++s) {
+        out[s] = NAN;
+        if (column.size() != nCounties || stateRanges.empty()) continue;
+        const auto& r = stateRanges[s];
+        float mean, sd;
+        size_t n;
+        seriesKernels::meanStdDev(column.data() + r.first, static_cast<size_t>(r.second - r.first), mean, sd, n);
+        if (n > 0) out[s] = mean;
+    }
+}
+
+vector<string> seriesStore::attributes() const {
+    vector<string> out;
+    for (const auto& m : matrices) out.push_back(m.first);
+    for (const auto& p : packed) out.push_back(p.first);
+    sort(out.begin(), out.end());
+    return out;
+}
+
+span<const float> seriesStore::matrix(const string& attribute, vector<float>& scratch) const {
+    auto it = matrices.find(attribute);
+    if (it != matrices.end()) return it->second;
+    auto pt = packed.find(attribute);
+    if (pt == packed.end()) return {};
+    scratch.resize(static_cast<size_t>(years) * nCounties);
+    columnCodec::decodeRows(pt->second, 0, static_cast<size_t>(years), scratch.data());
+    return scratch;
+}
+
+columnCodec::Codec seriesStore::codecOf(const string& attribute) const {
+    auto pt = packed.find(attribute);
+    return pt == packed.end() ? columnCodec::Codec::Float32 : pt->second.codec;
+}
+
+size_t seriesStore::byteSize(const string& attribute) const {
+    auto it = matrices.find(attribute);
+    if (it != matrices.end()) return it->second.size() * sizeof(float);
+    auto pt = packed.find(attribute);
+    return pt == packed.end() ? 0 : pt->second.byteSize();
+}
+
+size_t seriesStore::byteSize() const {
+    size_t bytes = 0;
+    for (const auto& m : matrices) bytes += m.second.size() * sizeof(float);
+    for (const auto& p : packed) bytes += p.second.byteSize();
+    return bytes;
+}
@@ -0,0 +1,65 @@
+#ifndef SERIESSTORE_H
+#define SERIESSTORE_H
+
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+#include "dataLoader.h"
+#include "countyIndex.h"
+#include "columnCodec.h"
+
+//Every attribute as one dense year-major matrix: the values of all counties
+//for a year are contiguous (indexed by countyIndex id, NaN where missing).
+//Alongside the raw attributes it holds derived series computed once per
+//dataset with the seriesKernels batch kernels:
+//  <attr>_YoY      change from the previous year
+//  <attr>_MA3      mean of this and the two previous years
+//  <attr>_Z_State  z-score against the counties of the same state that year
+//  <attr>_Z_US     z-score against all counties that year
+//With compact set the raw attributes are kept columnCodec-compressed after
+//the derived series are computed; reads decode them on the fly.
+class seriesStore {
+public:
+    void build(const AllData& allData, const countyIndex& counties, bool compact = false);
+
+    int firstYear() const { return baseYear; }
+    int lastYear() const { return baseYear + years - 1; }
+    bool has(const std::string& attribute) const { return matrices.count(attribute) != 0 || packed.count(attribute) != 0; }
+    const std::vector<std::string>& derivedAttributes() const { return derived; }
+    size_t countyCount() const { return nCounties; }
+    std::vector<std::string> attributes() const;   //raw and derived, sorted
+
+    //The whole years x countyCount matrix of attribute; empty if unknown.
+    //Compressed attributes are decoded into scratch, others are not copied.
+    std::span<const float> matrix(const std::string& attribute, std::vector<float>& scratch) const;
+
+    //Values of every county for attribute in year; empty if there are none.
+    std::span<const float> column(const std::string& attribute, int year, std::vector<float>& scratch) const;
+    //Same, written to out (countyCount floats); false if there are none.
+    bool readColumn(const std::string& attribute, int year, float* out) const;
+    float value(const std::string& attribute, int county, int year) const;   //NaN if missing
+
+    //Mean over the counties of each state, written to out[geography state id].
+    void stateMeans(const std::string& attribute, int year, float* out) const;
+    //Same for any column of countyCount values (e.g. a formula result).
+    void stateMeansOf(std::span<const float> column, float* out) const;
+
+    //Codec of attribute (Float32 unless compact) and the bytes it takes
+    columnCodec::Codec codecOf(const std::string& attribute) const;
+    size_t byteSize(const std::string& attribute) const;
+    size_t byteSize() const;   //all attributes
+
+private:
+    int baseYear = 0;
+    int years = 0;
+    size_t nCounties = 0;
+    std::vector<std::pair<int, int>> stateRanges;     //county id range per state id
+    std::map<std::string, std::vector<float>> matrices;   //attribute -> years * countyCount
+    std::map<std::string, columnCodec::Column> packed;    //compact raw attributes
+    std::vector<std::string> derived;
+
+    void deriveSeries(const std::string& attribute);
+};
+
+#endif //SERIESSTORE_H
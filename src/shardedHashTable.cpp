@@ -0,0 +1,64 @@
+#include <vector>
+#include "shardedHashTable.h"
+#include "trace.h"
+using namespace std;
+
+shardedHashTable::shardedHashTable(int shardCount)
+    : shardCount(shardCount < 1 ? 1 : shardCount), shards(new Shard[shardCount < 1 ? 1 : shardCount]) {}
+
+bool shardedHashTable::insert(const string& key, const string& value) {
+    if (isFrozen()) return false;
+    unsigned long long h = hashTable::hash(key);
+    Shard& s = shardFor(h);
+    lock_guard<mutex> g(s.lock);
+    //freeze() may have drained this shard while we waited for the lock
+    if (isFrozen()) return false;
+    return s.table.insert(key, value, h);
+}
+
+void shardedHashTable::reserve(int n) {
+    for (int i = 0; i < shardCount; i++) {
+        lock_guard<mutex> g(shards[i].lock);
+        shards[i].table.reserve(n / shardCount + 1);
+    }
+}
+
+void shardedHashTable::freeze() {
+    TRACE_SCOPE("shardedHashTable::freeze");
+    //Drain pending incremental rehashes so lock-free readers never see a table mid-move.
+    //Every shard stays locked until frozen is set, so no insert can slip in after its drain.
+    vector<unique_lock<mutex>> held;
+    held.reserve(shardCount);
+    for (int i = 0; i < shardCount; i++) {
+        held.emplace_back(shards[i].lock);
+        shards[i].table.finishRehash();
+    }
+    frozen.store(true, memory_order_release);
+}
+
+string shardedHashTable::search(const string& state, const string& county, const string& attribute, const string& year) const {
+    string key = hashTable::makeKey(state, county, attribute, year);
+    unsigned long long h = hashTable::hash(key);
+    Shard& s = shardFor(h);
+    const string* v;
+    if (isFrozen()) {
+        v = s.table.lookup(key, h);
+        return v ? *v : "Not found";
+    }
+    lock_guard<mutex> g(s.lock);
+    v = s.table.lookup(key, h);
+    return v ? *v : "Not found";
+}
+
+int shardedHashTable::size() const {
+    int total = 0;
+    for (int i = 0; i < shardCount; i++) {
+        if (isFrozen()) {
+            total += shards[i].table.size();
+        } else {
+            lock_guard<mutex> g(shards[i].lock);
+            total += shards[i].table.size();
+        }
+    }
+    return total;
+}
@@ -0,0 +1,41 @@
+#ifndef SHARDEDHASHTABLE_H
+#define SHARDEDHASHTABLE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "hashTable.h"
+
+//hashTable split into independently locked shards so several loader threads
+//can insert at once. Once freeze() is called the table is read-only and
+//search() takes no locks at all.
+class shardedHashTable {
+private:
+    struct Shard {
+        std::mutex lock;
+        hashTable table;
+    };
+
+    int shardCount;
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<bool> frozen{false};
+
+    Shard& shardFor(unsigned long long h) const { return shards[(h >> 40) % shardCount]; }
+
+public:
+    explicit shardedHashTable(int shardCount = 16);
+    shardedHashTable(const shardedHashTable&) = delete;
+    shardedHashTable& operator=(const shardedHashTable&) = delete;
+
+    bool insert(const std::string& key, const std::string& value);   //false if present or frozen
+    void reserve(int n);
+    void freeze();
+    bool isFrozen() const { return frozen.load(std::memory_order_acquire); }
+
+    //Same key format and "Not found" result as hashTable::search
+    std::string search(const std::string& state, const std::string& county, const std::string& attribute, const std::string& year) const;
+    int size() const;
+};
+
+#endif //SHARDEDHASHTABLE_H
@@ -0,0 +1,110 @@
+#include "trace.h"
+
+#ifdef ECONVIS_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace trace {
+
+    namespace {
+        struct Event {
+            const char* name;   //always a string literal
+            long long start;
+            long long dur;
+        };
+
+        //Each thread appends to its own buffer without locking; the registry
+        //lock is only taken once per thread and when writing the file.
+        struct ThreadBuffer {
+            int tid = 0;
+            string threadName;
+            vector<Event> events;
+            size_t dropped = 0;
+        };
+
+        const size_t kMaxEventsPerThread = 1 << 20;
+
+        mutex registryLock;
+        vector<unique_ptr<ThreadBuffer>> registry;
+        atomic<int> nextTid{1};
+        const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+        ThreadBuffer& localBuffer() {
+            thread_local ThreadBuffer* buf = nullptr;
+            if (!buf) {
+                auto owned = make_unique<ThreadBuffer>();
+                owned->tid = nextTid.fetch_add(1);
+                owned->events.reserve(4096);
+                buf = owned.get();
+                lock_guard<mutex> g(registryLock);
+                registry.push_back(std::move(owned));
+            }
+            return *buf;
+        }
+
+        void writeEscaped(ofstream& out, const string& s) {
+            for (char c : s) {
+                if (c == '"' || c == '\\') out << '\\';
+                out << c;
+            }
+        }
+    }
+
+    long long nowUs() {
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - epoch).count();
+    }
+
+    void record(const char* name, long long startUs, long long durUs) {
+        ThreadBuffer& buf = localBuffer();
+        if (buf.events.size() >= kMaxEventsPerThread) { buf.dropped++; return; }
+        buf.events.push_back({name, startUs, durUs});
+    }
+
+    void setThreadName(const char* name) {
+        localBuffer().threadName = name;
+    }
+
+    bool writeFile(const string& path) {
+        ofstream out(path);
+        if (!out) {
+            cerr << "Cannot write trace file " << path << endl;
+            return false;
+        }
+        lock_guard<mutex> g(registryLock);
+        size_t total = 0, dropped = 0;
+        bool first = true;
+        out << "{\"traceEvents\":[\n";
+        for (const auto& buf : registry) {
+            if (!buf->threadName.empty()) {
+                out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buf->tid
+                    << ",\"args\":{\"name\":\"";
+                writeEscaped(out, buf->threadName);
+                out << "\"}}";
+                first = false;
+            }
+            for (const auto& e : buf->events) {
+                out << (first ? "" : ",\n") << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buf->tid
+                    << ",\"ts\":" << e.start << ",\"dur\":" << e.dur << "}";
+                first = false;
+            }
+            total += buf->events.size();
+            dropped += buf->dropped;
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        cout << "Trace: " << total << " events written to " << path;
+        if (dropped) cout << " (" << dropped << " dropped)";
+        cout << endl;
+        return true;
+    }
+
+} // namespace trace
+
+#endif //ECONVIS_TRACE
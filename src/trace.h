@@ -0,0 +1,46 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+//Scoped Chrome trace-event instrumentation (chrome://tracing, ui.perfetto.dev).
+//Only active when built with ECONVIS_TRACE (cmake -DENABLE_TRACE=ON); otherwise
+//every macro below expands to nothing.
+//  TRACE_SCOPE("name")        time the enclosing block
+//  TRACE_THREAD_NAME("name")  label the calling thread in the viewer
+//  TRACE_WRITE("trace.json")  dump everything recorded so far (call once other
+//                             threads have stopped recording)
+
+#ifdef ECONVIS_TRACE
+
+#include <string>
+
+namespace trace {
+    long long nowUs();
+    void record(const char* name, long long startUs, long long durUs);
+    void setThreadName(const char* name);
+    bool writeFile(const std::string& path);
+
+    struct Scope {
+        const char* name;
+        long long start;
+        explicit Scope(const char* n) : name(n), start(nowUs()) {}
+        ~Scope() { record(name, start, nowUs() - start); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+}
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) trace::setThreadName(name)
+#define TRACE_WRITE(path) trace::writeFile(path)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_WRITE(path) ((void)0)
+
+#endif //ECONVIS_TRACE
+
+#endif //TRACE_H
@@ -6,16 +6,29 @@
 #include <map>
 #include <cmath>
 #include "tree.h"
+#include "geography.h"
+#include "trace.h"
 
 using namespace std;
 
-Tree::Tree() : root(new GeoNode("United States")) {}
+Tree::Tree(RegionLayer layer) : root(new GeoNode("United States")), regionLayer(layer) {
+    levels[root->name] = root;
+}
 
 Tree::~Tree() {
     delete root;
 }
 
-bool Tree::insert(string fullPath, string dataType, vector<float> values, vector<string> labels) {
+Tree::GeoNode* Tree::countyNode(const string& fullPath, bool create) {
+    if (!create) {
+        //State nodes are indexed, so only the county has to be searched for
+        size_t slash = fullPath.find('/');
+        if (slash == string::npos) return nullptr;
+        auto it = levels.find(fullPath.substr(0, slash));
+        if (it == levels.end()) return nullptr;
+        return dynamic_cast<GeoNode*>(it->second->findChild(fullPath.substr(slash + 1)));
+    }
+
     GeoNode* current = root;
     stringstream ss(fullPath);
     string segment;
@@ -26,21 +39,180 @@ bool Tree::insert(string fullPath, string dataType, vector<float> values, vector
         if (!segment.empty()) parts.push_back(segment);
     }
 
+    //States hang under their region or division
+    int stateId = parts.empty() ? -1 : geography::stateIdFromName(parts[0]);
+    if (stateId >= 0 && regionLayer == RegionLayer::CensusRegions) {
+        parts.insert(parts.begin(), string(geography::kRegions[geography::regionOf(stateId)]));
+    } else if (stateId >= 0 && regionLayer == RegionLayer::CensusDivisions) {
+        parts.insert(parts.begin(), string(geography::kDivisions[geography::kStates[stateId].division].name));
+    }
+    size_t levelParts = parts.size() - 1;   //everything above the county
+
     //Walk or create the hierarchy
-    for (const auto& part : parts) {
-        Node* found = current->findChild(part);
+    for (size_t i = 0; i < parts.size(); ++i) {
+        Node* found = current->findChild(parts[i]);
         if (found) {
             current = dynamic_cast<GeoNode*>(found);
         } else {
-            current = current->emplaceChild<GeoNode>(part, current);
+            current = current->emplaceChild<GeoNode>(parts[i], current);
+            if (i < levelParts) levels[parts[i]] = current;
         }
     }
+    return current;
+}
+
+Tree::DataNode* Tree::findSeries(const GeoNode* county, const string& dataType) {
+    for (const auto& childUPtr : county->children) {
+        DataNode* data = dynamic_cast<DataNode*>(childUPtr.get());
+        if (data && *data->dataType == dataType) return data;
+    }
+    return nullptr;
+}
+
+bool Tree::insert(const string& fullPath, const string& dataType, int baseYear, const vector<float>& values) {
+    GeoNode* current = countyNode(fullPath, true);
+
+    //Re-inserting a series overwrites it instead of adding a second node
+    if (DataNode* existing = findSeries(current, dataType)) {
+        if (!values.empty()) ensureYears(existing, baseYear, baseYear + static_cast<int>(values.size()) - 1);
+        for (int y = existing->baseYear; y < existing->baseYear + static_cast<int>(existing->length); ++y) {
+            size_t i = static_cast<size_t>(y - baseYear);
+            setValue(current, existing, y, y >= baseYear && i < values.size() ? values[i] : NAN);
+        }
+        compactPool();
+        return true;
+    }
 
     //Add data node under this geo node
-    current->emplaceChild<DataNode>(dataType, values, labels, current);
+    const string* type = &*attributeNames.insert(dataType).first;
+    current->emplaceChild<DataNode>(type, baseYear, static_cast<uint32_t>(pool.size()),
+                                    static_cast<uint16_t>(values.size()), current);
+    pool.insert(pool.end(), values.begin(), values.end());
+    dataNodes++;
+
+    //Fold the new series into the rollups of every level above it
+    for (GeoNode* g = current->parent; g; g = g->parent) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (!isnan(values[i])) g->addToRollup(dataType, baseYear + static_cast<int>(i), values[i]);
+        }
+    }
     return true;
 }
 
+bool Tree::upsert(const string& fullPath, const string& dataType, int year, float value) {
+    if (isnan(value)) return remove(fullPath, dataType, year);
+    GeoNode* county = countyNode(fullPath, false);
+    DataNode* data = county ? findSeries(county, dataType) : nullptr;
+    if (!data) return insert(fullPath, dataType, year, vector<float>(1, value));
+    ensureYears(data, year, year);
+    setValue(county, data, year, value);
+    compactPool();
+    return true;
+}
+
+bool Tree::remove(const string& fullPath, const string& dataType, int year) {
+    GeoNode* county = countyNode(fullPath, false);
+    DataNode* data = county ? findSeries(county, dataType) : nullptr;
+    if (!data || isnan(valueAt(data, year))) return false;
+    setValue(county, data, year, NAN);
+
+    const float* values = pool.data() + data->offset;
+    if (all_of(values, values + data->length, [](float v) { return isnan(v); })) {
+        poolWaste += data->length;
+        dataNodes--;
+        auto& children = county->children;
+        children.erase(find_if(children.begin(), children.end(),
+                               [data](const unique_ptr<Node>& ch) { return ch.get() == data; }));
+    }
+    compactPool();
+    return true;
+}
+
+void Tree::ensureYears(DataNode* data, int first, int last) {
+    int oldFirst = data->baseYear;
+    int oldLast = oldFirst + static_cast<int>(data->length) - 1;
+    if (data->length > 0 && first >= oldFirst && last <= oldLast) return;
+    if (data->length > 0) {
+        first = min(first, oldFirst);
+        last = max(last, oldLast);
+    }
+
+    //The neighbours in the pool are other series, so a longer one moves to the end
+    uint32_t offset = static_cast<uint32_t>(pool.size());
+    pool.resize(pool.size() + (last - first + 1), NAN);
+    copy(pool.begin() + data->offset, pool.begin() + data->offset + data->length,
+         pool.begin() + offset + (oldFirst - first));
+    poolWaste += data->length;
+    data->offset = offset;
+    data->length = static_cast<uint16_t>(last - first + 1);
+    data->baseYear = static_cast<int16_t>(first);
+}
+
+void Tree::setValue(GeoNode* county, DataNode* data, int year, float value) {
+    size_t i = static_cast<size_t>(year - data->baseYear);
+    float& slot = pool[data->offset + i];
+    float old = slot;
+    if ((isnan(old) && isnan(value)) || old == value) return;
+    slot = value;
+
+    //Bottom up, so a level that has to recompute min/max reads already updated children
+    for (GeoNode* g = county->parent; g; g = g->parent) {
+        bool stale = !isnan(old) && g->removeFromRollup(*data->dataType, year, old);
+        if (!isnan(value)) g->addToRollup(*data->dataType, year, value);
+        if (stale) refreshExtremes(g, *data->dataType, year);
+    }
+}
+
+void Tree::refreshExtremes(GeoNode* g, const string& dataType, int year) {
+    GeoNode::YearRollups& yr = g->rollups[dataType];
+    Rollup& a = yr.years[year - yr.baseYear];
+    a.min = a.max = NAN;
+    auto fold = [&a](float lo, float hi) {
+        a.min = isnan(a.min) ? lo : min(a.min, lo);
+        a.max = isnan(a.max) ? hi : max(a.max, hi);
+    };
+    for (const auto& ch : g->children) {
+        const GeoNode* child = dynamic_cast<const GeoNode*>(ch.get());
+        if (!child) continue;
+        //Regions and states carry rollups; counties only their series
+        auto it = child->rollups.find(dataType);
+        if (it != child->rollups.end()) {
+            int i = year - it->second.baseYear;
+            if (i >= 0 && i < static_cast<int>(it->second.years.size()) && it->second.years[i].count > 0) {
+                fold(it->second.years[i].min, it->second.years[i].max);
+            }
+            continue;
+        }
+        const DataNode* data = findSeries(child, dataType);
+        float v = data ? valueAt(data, year) : NAN;
+        if (!isnan(v)) fold(v, v);
+    }
+}
+
+void Tree::compactPool() {
+    //Moved and removed series leave holes; repack once they are half the pool
+    if (poolWaste < 4096 || poolWaste * 2 < pool.size()) return;
+    TRACE_SCOPE("Tree::compactPool");
+    vector<float> packed;
+    packed.reserve(pool.size() - poolWaste);
+    vector<const GeoNode*> stack = {root};
+    while (!stack.empty()) {
+        const GeoNode* g = stack.back();
+        stack.pop_back();
+        for (const auto& ch : g->children) {
+            if (const auto* geo = dynamic_cast<const GeoNode*>(ch.get())) {
+                stack.push_back(geo);
+            } else if (auto* data = dynamic_cast<DataNode*>(ch.get())) {
+                uint32_t offset = static_cast<uint32_t>(packed.size());
+                packed.insert(packed.end(), pool.begin() + data->offset, pool.begin() + data->offset + data->length);
+                data->offset = offset;
+            }
+        }
+    }
+    pool.swap(packed);
+    poolWaste = 0;
+}
+
 void Tree::print() const {
     cout << "=== Economic Tree ===\n";
     printNode(root, 0);
@@ -58,160 +230,173 @@ void Tree::printNode(const Node* n, int depth) const {
             printNode(ch.get(), depth + 1);
     }
     else if (const auto* dat = dynamic_cast<const DataNode*>(n)) {
-        cout << indent << "Data: " << dat->dataType << " (" << dat->values.size() << " years)\n";
-        if (!dat->values.empty()) {
+        cout << indent << "Data: " << *dat->dataType << " (" << dat->length << " years from " << dat->baseYear << ")\n";
+        if (dat->length > 0) {
+            const float* values = pool.data() + dat->offset;
+            size_t n = dat->length;
             cout << indent << "  values: [";
-            size_t show = min<size_t>(3, dat->values.size());
+            size_t show = min<size_t>(3, n);
             for (size_t i = 0; i < show; ++i)
-                cout << fixed << setprecision(2) << dat->values[i] << (i+1 < show ? ", " : "");
-            if (dat->values.size() > 6)
+                cout << fixed << setprecision(2) << values[i] << (i+1 < show ? ", " : "");
+            if (n > 6)
                 cout << " ... ";
-            if (dat->values.size() > 3) {
-                for (size_t i = dat->values.size() - 3; i < dat->values.size(); ++i)
-                    cout << fixed << setprecision(2) << dat->values[i] << (i+1 < dat->values.size() ? ", " : "");
+            if (n > 3) {
+                for (size_t i = n - 3; i < n; ++i)
+                    cout << fixed << setprecision(2) << values[i] << (i+1 < n ? ", " : "");
             }
             cout << "]\n";
         }
     }
 }
 
-vector<float> Tree::getDisplayData() const
+vector<float> Tree::getDisplayData(const vector<pair<string, float>>& weights) const
 {
-    vector<float> displayData;
-
-    const GeoNode* us = root;
-    for (const auto& stateUPtr : us->children) {
-        const GeoNode* stateNode = dynamic_cast<const GeoNode*>(stateUPtr.get());
-        if (!stateNode) continue;
-
-        // attribute name = <sum of averages, number of counties that have it>
-        map<string, pair<float, int>> attrStats;
-
-        //Walk through every county of this state
+    TRACE_SCOPE("Tree::getDisplayData");
+    //Indexed by geography state id; NaN for states without data
+    vector<float> displayData(geography::kStateCount, NAN);
+
+    for (const auto& state : geography::kStates) {
+        auto found = levels.find(string(state.name));
+        if (found == levels.end()) continue;
+        const GeoNode* stateNode = found->second;
+
+        //Per attribute, the mean over the state's counties of each county's own mean over
+        //its years, so a county counts once however many years it has
+        vector<pair<float, int>> attrStats(weights.size(), {0.0f, 0});   //sum of county means, counties
         for (const auto& countyUPtr : stateNode->children) {
             const GeoNode* countyNode = dynamic_cast<const GeoNode*>(countyUPtr.get());
             if (!countyNode) continue;
-
             for (const auto& childUPtr : countyNode->children) {
                 const DataNode* data = dynamic_cast<const DataNode*>(childUPtr.get());
-                if (!data || data->values.empty()) continue;
-
-                //average of the time-series for this attribute
+                if (!data) continue;
+                size_t w = 0;
+                while (w < weights.size() && weights[w].first != *data->dataType) ++w;
+                if (w == weights.size()) continue;
                 float sum = 0.0f;
-                for (float v : data->values) sum += v;
-                float avg = sum / static_cast<float>(data->values.size());
-
-                //update running statistics for this attribute
-                auto& p = attrStats[data->dataType];
-                p.first  += avg;          // sum of averages
-                p.second += 1;            // how many counties contributed
+                int present = 0;
+                for (size_t i = 0; i < data->length; ++i) {
+                    float v = pool[data->offset + i];
+                    if (isnan(v)) continue;
+                    sum += v;
+                    present++;
+                }
+                if (present == 0) continue;
+                attrStats[w].first += sum / static_cast<float>(present);
+                attrStats[w].second += 1;
             }
         }
 
-        //Build the final per-attribute state averages
-        const vector<string> requiredOrder = {
-            "Civilian_labor_force",
-            "Employed",
-            "Med_HH_Income_Percent_of_State_Total",
-            "Median_Household_Income",
-            "Metro",
-            "Rural_Urban_Continuum_Code",
-            "Unemployed",
-            "Unemployment_rate",
-            "Urban_Influence_Code"
-        };
-
-        vector<float> stateValues;
-        stateValues.reserve(requiredOrder.size());
-
-        for (const auto& attrName : requiredOrder) {
-            auto it = attrStats.find(attrName);
-            if (it == attrStats.end() || it->second.second == 0) {
-                stateValues.push_back(0.0f);
-            } else {
-                float stateAvg = it->second.first / static_cast<float>(it->second.second);
-                stateValues.push_back(stateAvg);
-            }
+        //Weighted sum of the state averages; an attribute the state has no data for counts as 0
+        float stateTotal = 0.0f;
+        for (size_t w = 0; w < weights.size(); ++w) {
+            if (attrStats[w].second > 0) stateTotal += attrStats[w].first / attrStats[w].second * weights[w].second;
         }
+        displayData[state.id] = stateTotal;
+    }
 
-        //Debug
-        // cout << stateNode->name << " Vector: ";
-        // for (float v : stateValues) cout << v << " ";
-        // cout << endl;
+    return displayData;
+}
 
-        //Special UNEMPLOYMENT Algorithm
-        float stateTotal = 0.0f;
-        if (stateValues.size() == 9) {
-            stateTotal +=
-                stateValues[0] * -0.000005f +  // Civilian_labor_force
-                stateValues[1] * -0.00001f +  // Employed
-                stateValues[2] * 0.0005f  +   // Med_HH_Income_Percent_of_State_Total
-                stateValues[3] * -0.00001f +  // Median_Household_Income
-                stateValues[4] * -1.0f    +   // Metro
-                stateValues[5] * 0.3f    +   // Rural_Urban_Continuum_Code
-                stateValues[6] * 0.0003f +   // Unemployed
-                stateValues[7] * 0.5f    +   // Unemployment_rate
-                stateValues[8] * 0.1f;       // Urban_Influence_Code
-        }
+const Tree::GeoNode* Tree::findState(const string& stateAbbrev) const {
+    int stateId = geography::stateIdFromAbbrev(stateAbbrev);
+    if (stateId < 0) return nullptr;
+    auto it = levels.find(string(geography::kStates[stateId].name));
+    return it == levels.end() ? nullptr : it->second;
+}
+
+const Tree::DataNode* Tree::findData(const string& stateAbbrev, const string& countyName, const string& dataType) const {
+    const GeoNode* state = findState(stateAbbrev);
+    return state ? findData(state, countyName, dataType) : nullptr;
+}
 
-        displayData.push_back(stateTotal);
+const Tree::DataNode* Tree::findData(const GeoNode* state, const string& countyName, const string& dataType, int* visits) const {
+    int seen = 1;
+    const GeoNode* county = nullptr;
+    for (const auto& ch : state->children) {
+        ++seen;
+        const auto* geo = dynamic_cast<const GeoNode*>(ch.get());
+        if (geo && geo->name == countyName) { county = geo; break; }
     }
+    const DataNode* found = nullptr;
+    if (county) {
+        for (const auto& childUPtr : county->children) {
+            ++seen;
+            const DataNode* data = dynamic_cast<const DataNode*>(childUPtr.get());
+            if (data && *data->dataType == dataType) { found = data; break; }
+        }
+    }
+    if (visits) *visits += seen;
+    return found;
+}
 
-    return displayData;
+Tree::StateRef Tree::stateRef(const string& stateAbbrev) const {
+    StateRef ref;
+    ref.node = findState(stateAbbrev);
+    return ref;
+}
+
+float Tree::value(StateRef state, const string& countyName, const string& dataType, int year, int* visits) const {
+    if (!state) return NAN;
+    const DataNode* data = findData(state.node, countyName, dataType, visits);
+    return data ? valueAt(data, year) : NAN;
 }
 
 string Tree::searchValue(const string& stateAbbrev, const string& countyName, const string& dataType, string yearString) const {
-    map<string, string> abbrevToFull = {
-        {"AL", "Alabama"}, {"AK", "Alaska"}, {"AZ", "Arizona"}, {"AR", "Arkansas"},
-        {"CA", "California"}, {"CO", "Colorado"}, {"CT", "Connecticut"}, {"DE", "Delaware"},
-        {"DC", "District of Columbia"}, {"FL", "Florida"}, {"GA", "Georgia"}, {"HI", "Hawaii"},
-        {"ID", "Idaho"}, {"IL", "Illinois"}, {"IN", "Indiana"}, {"IA", "Iowa"},
-        {"KS", "Kansas"}, {"KY", "Kentucky"}, {"LA", "Louisiana"}, {"ME", "Maine"},
-        {"MD", "Maryland"}, {"MA", "Massachusetts"}, {"MI", "Michigan"}, {"MN", "Minnesota"},
-        {"MS", "Mississippi"}, {"MO", "Missouri"}, {"MT", "Montana"}, {"NE", "Nebraska"},
-        {"NV", "Nevada"}, {"NH", "New Hampshire"}, {"NJ", "New Jersey"}, {"NM", "New Mexico"},
-        {"NY", "New York"}, {"NC", "North Carolina"}, {"ND", "North Dakota"}, {"OH", "Ohio"},
-        {"OK", "Oklahoma"}, {"OR", "Oregon"}, {"PA", "Pennsylvania"}, {"RI", "Rhode Island"},
-        {"SC", "South Carolina"}, {"SD", "South Dakota"}, {"TN", "Tennessee"}, {"TX", "Texas"},
-        {"UT", "Utah"}, {"VT", "Vermont"}, {"VA", "Virginia"}, {"WA", "Washington"},
-        {"WV", "West Virginia"}, {"WI", "Wisconsin"}, {"WY", "Wyoming"}
-    };
-    const GeoNode* current = root;
     int year = stoi(yearString);
-    vector<string> parts;
 
-    auto it = abbrevToFull.find(stateAbbrev);
-    if (it == abbrevToFull.end()){
+    if (geography::stateIdFromAbbrev(stateAbbrev) < 0){
         cout << "Unknown state abbreviation" << endl;
         return "Not Found";
     }
-    string stateName = it->second;
-
-    string fullCountyName = countyName + " County";
 
-    parts.push_back(stateName);
-    parts.push_back(fullCountyName);
+    const DataNode* data = findData(stateAbbrev, countyName, dataType);
+    if (!data) return "Not Found";
+    float v = valueAt(data, year);
+    if (isnan(v)) return "Not Found";
+    return to_string(v);
+}
 
-    //Walk the hierarchy
-    for (const auto& part : parts) {
-        Node* found = current->findChild(part);
-        if (found) {
-            current = dynamic_cast<const GeoNode*>(found);
-        } else {
-            return "Not Found";
-        }
-    }
+Tree::SeriesView Tree::range(const string& stateAbbrev, const string& countyName, const string& dataType, int yearA, int yearB) const {
+    SeriesView view;
+    const DataNode* data = findData(stateAbbrev, countyName, dataType);
+    if (!data) return view;
+    int first = max(yearA, static_cast<int>(data->baseYear));
+    int last = min(yearB, data->baseYear + static_cast<int>(data->length) - 1);
+    if (first > last) return view;
+    view.firstYear = first;
+    view.values = span<const float>(pool).subspan(data->offset + (first - data->baseYear), last - first + 1);
+    return view;
+}
 
-    //Find the DataNode with the specified dataType
-    for (const auto& childUPtr : current->children) {
-        const DataNode* data = dynamic_cast<const DataNode*>(childUPtr.get());
-        if (data && data->dataType == dataType) {
-            if (year >= 2000 && year < 2000 + static_cast<int>(data->values.size())) {
-                // Year starts from 2000
-                return to_string(data->values[year - 2000]); 
-            }
+size_t Tree::stateRange(const string& stateAbbrev, const string& dataType, int yearA, int yearB, Aggregate agg, float* out) const {
+    if (yearB < yearA) return 0;
+    size_t n = static_cast<size_t>(yearB - yearA + 1);
+    fill(out, out + n, NAN);
+    const GeoNode* state = findState(stateAbbrev);
+    if (!state) return n;
+    auto it = state->rollups.find(dataType);
+    if (it == state->rollups.end()) return n;
+    const GeoNode::YearRollups& yr = it->second;
+    for (int y = max(yearA, yr.baseYear); y <= min(yearB, yr.baseYear + static_cast<int>(yr.years.size()) - 1); ++y) {
+        const Rollup& r = yr.years[y - yr.baseYear];
+        if (r.count == 0) continue;
+        switch (agg) {
+            case Aggregate::Sum:  out[y - yearA] = static_cast<float>(r.sum); break;
+            case Aggregate::Mean: out[y - yearA] = r.mean(); break;
+            case Aggregate::Min:  out[y - yearA] = r.min; break;
+            case Aggregate::Max:  out[y - yearA] = r.max; break;
         }
     }
+    return n;
+}
 
-    return "Not Found";
-}
\ No newline at end of file
+Tree::Rollup Tree::aggregate(const string& geo, const string& dataType, int year) const {
+    int stateId = geography::stateIdFromAbbrev(geo);
+    auto node = levels.find(stateId >= 0 ? string(geography::kStates[stateId].name) : geo);
+    if (node == levels.end()) return Rollup();
+    auto it = node->second->rollups.find(dataType);
+    if (it == node->second->rollups.end()) return Rollup();
+    int i = year - it->second.baseYear;
+    if (i < 0 || i >= static_cast<int>(it->second.years.size())) return Rollup();
+    return it->second.years[i];
+}
@@ -4,13 +4,30 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
 #include <variant>
 #include <string>
 #include <memory>
+#include <span>
+#include <cmath>
 
 
 using namespace std;
 class Tree{
+public:
+    //Optional layer of geography nodes between the nation and the states
+    enum class RegionLayer { None, CensusRegions, CensusDivisions };
+
+    //Aggregate of one attribute in one year over every county below a node
+    struct Rollup {
+        double sum = 0.0;
+        int count = 0;
+        float min = NAN;
+        float max = NAN;
+        float mean() const { return count ? static_cast<float>(sum / count) : NAN; }
+    };
+
 private:
     struct Node {
         virtual ~Node() = default;
@@ -21,6 +38,12 @@ private:
         std::string name;
         GeoNode* parent = nullptr;
         std::vector<std::unique_ptr<Node>> children;
+        //attribute -> rollup per year from baseYear; kept on nation, region and state nodes
+        struct YearRollups {
+            int baseYear = 0;
+            std::vector<Rollup> years;
+        };
+        std::unordered_map<std::string, YearRollups> rollups;
 
         explicit GeoNode(std::string n, GeoNode* p = nullptr)
             : name(std::move(n)), parent(p) {}
@@ -40,6 +63,38 @@ private:
             return nullptr;
         }
 
+        void addToRollup(const std::string& dataType, int year, float v) {
+            YearRollups& r = rollups[dataType];
+            if (r.years.empty()) r.baseYear = year;
+            if (year < r.baseYear) {
+                r.years.insert(r.years.begin(), r.baseYear - year, Rollup());
+                r.baseYear = year;
+            }
+            size_t i = static_cast<size_t>(year - r.baseYear);
+            if (i >= r.years.size()) r.years.resize(i + 1);
+            Rollup& a = r.years[i];
+            a.sum += v;
+            a.min = a.count ? std::min(a.min, v) : v;
+            a.max = a.count ? std::max(a.max, v) : v;
+            a.count++;
+        }
+
+        //Takes v back out; true if it was the min or max, which then has to be recomputed
+        bool removeFromRollup(const std::string& dataType, int year, float v) {
+            auto it = rollups.find(dataType);
+            if (it == rollups.end()) return false;
+            size_t i = static_cast<size_t>(year - it->second.baseYear);
+            if (i >= it->second.years.size()) return false;
+            Rollup& a = it->second.years[i];
+            if (a.count == 0) return false;
+            a.sum -= v;
+            if (--a.count == 0) {
+                a = Rollup();
+                return false;
+            }
+            return v <= a.min || v >= a.max;
+        }
+
         //DataNode or GeoNode
         template<class T, class... Args>
         T* emplaceChild(Args&&... args){
@@ -57,21 +112,38 @@ private:
     };
 
     GeoNode* root;
+    RegionLayer regionLayer;
+    size_t dataNodes = 0;
+    size_t poolWaste = 0;   //pool values no DataNode points at any more (moved or removed series)
+    std::unordered_map<std::string, GeoNode*> levels;   //nation, region and state nodes by name
+
+    //Values of every series, back to back; a DataNode keeps an offset into it
+    std::vector<float> pool;
+    //One copy of each attribute name; DataNodes point into it (set nodes never move)
+    std::unordered_set<std::string> attributeNames;
 
     struct DataNode : Node {
-        std::string dataType;
-        std::vector<float>  values;
-        std::vector<std::string> labels;
+        const std::string* dataType;     //interned in attributeNames
         GeoNode* parent = nullptr;
+        uint32_t offset;                 //pool[offset] is the value for baseYear
+        uint16_t length;                 //consecutive years from baseYear
+        int16_t baseYear;
 
-        DataNode(std::string type,
-                std::vector<float>  v,
-                std::vector<std::string> l,
+        DataNode(const std::string* type,
+                int base,
+                uint32_t off,
+                uint16_t len,
                 GeoNode* p = nullptr)
-            : dataType(std::move(type))
-            , values(std::move(v))
-            , labels(std::move(l))
-            , parent(p) {}
+            : dataType(type)
+            , parent(p)
+            , offset(off)
+            , length(len)
+            , baseYear(static_cast<int16_t>(base)) {}
+        //Year inside the stored range; the value there may still be a NaN gap
+        bool covers(int year) const {
+            int i = year - baseYear;
+            return i >= 0 && i < length;
+        }
         // Path = parent path + '/' + "(data)"
         std::string path() const override {
             if (!parent) return "/(data)";
@@ -85,13 +157,73 @@ private:
         void setParent(GeoNode* p) { parent = p; }
         friend struct GeoNode;
     };
+    const GeoNode* findState(const string& stateAbbrev) const;
+    const DataNode* findData(const string& stateAbbrev, const string& countyName, const string& dataType) const;
+    //With visits, adds the nodes looked at: the state, each county child compared, each series child compared
+    const DataNode* findData(const GeoNode* state, const string& countyName, const string& dataType, int* visits = nullptr) const;
+    //County node of "State/County ..." path; with create the missing levels are added
+    GeoNode* countyNode(const string& fullPath, bool create);
+    static DataNode* findSeries(const GeoNode* county, const string& dataType);
+    //The series' value for year, NaN if it has none
+    float valueAt(const DataNode* data, int year) const {
+        return data->covers(year) ? pool[data->offset + (year - data->baseYear)] : NAN;
+    }
+    //Grows the series to cover [first, last], moving it to the end of the pool if needed
+    void ensureYears(DataNode* data, int first, int last);
+    //Writes one value (NaN = missing) in place and updates the rollups above the county
+    void setValue(GeoNode* county, DataNode* data, int year, float value);
+    //Recomputes min and max of one rollup from the node's direct children
+    void refreshExtremes(GeoNode* g, const string& dataType, int year);
+    void compactPool();
+
 public:
-    Tree();
-    bool insert(string name, string dataType, vector<float> values, vector<string> labels);
+    //Consecutive years of one series; values[i] belongs to firstYear + i
+    struct SeriesView {
+        int firstYear = 0;
+        std::span<const float> values;
+    };
+    enum class Aggregate { Sum, Mean, Min, Max };
+
+    explicit Tree(RegionLayer layer = RegionLayer::CensusRegions);
+    Tree(const Tree&) = delete;             //owns raw root, never copy
+    Tree& operator=(const Tree&) = delete;
+    //values[i] is the value for baseYear + i (NaN for a missing year). An existing series of the
+    //same attribute is replaced in place.
+    bool insert(const string& name, const string& dataType, int baseYear, const vector<float>& values);
+    //Sets one value of a county, adding the series or year if it is new. Rollups stay exact.
+    bool upsert(const string& name, const string& dataType, int year, float value);
+    //Drops one value; a series left without values is removed. False if there was no such value.
+    bool remove(const string& name, const string& dataType, int year);
+    void reserveValues(size_t n) { pool.reserve(n); }
+    size_t dataNodeCount() const { return dataNodes; }
     void print() const;
     void printNode(const Node* n, int depth = 0) const;
+    //countyName is the full name as in the data: "Alachua County", "Orleans Parish"
     string searchValue(const string& stateAbbrev, const string& countyName, const string& dataType, string yearString) const;
-    vector<float> getDisplayData() const;
+    //The county's series clipped to [yearA, yearB]; empty if it has no such attribute or no overlap.
+    //Points into the tree's value pool, so it is valid until the next insert, upsert or remove.
+    SeriesView range(const string& stateAbbrev, const string& countyName, const string& dataType, int yearA, int yearB) const;
+    //A state resolved once for repeated lookups in it; empty if the abbreviation is unknown
+    class StateRef {
+    public:
+        explicit operator bool() const { return node != nullptr; }
+    private:
+        const GeoNode* node = nullptr;
+        friend class Tree;
+    };
+    StateRef stateRef(const string& stateAbbrev) const;
+    //One value of a county of a resolved state, NaN if there is none. Builds no strings; with
+    //visits the nodes the walk looked at are counted (see findData).
+    float value(StateRef state, const string& countyName, const string& dataType, int year, int* visits = nullptr) const;
+    //Aggregate over all counties of the state for each year of [yearA, yearB], written to
+    //out[0 .. yearB-yearA]; NaN for years no county has. Returns the number of years written.
+    size_t stateRange(const string& stateAbbrev, const string& dataType, int yearA, int yearB, Aggregate agg, float* out) const;
+    //Cached aggregate at a geography level: "United States", a region or division name,
+    //a state name or abbreviation. count is 0 if there is no data.
+    Rollup aggregate(const string& geo, const string& dataType, int year) const;
+    //NEED value per geography state id: sum of weight * state mean of each attribute, the
+    //state mean being the mean over its counties of each county's mean over its years
+    vector<float> getDisplayData(const vector<pair<string, float>>& weights) const;
     ~Tree();
 };
 